@@ -0,0 +1,496 @@
+#include "schoenberg.h"
+#include "io.h"
+#include "bench_keymap.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace schoenberg;
+
+// counts every heap allocation of the benchmark
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    if (auto p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+uint64_t now_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+input_event key_event(int code, int value) {
+    return input_event{.type = EV_KEY, .code = (__u16) code, .value = value};
+}
+
+/**
+ * deterministic typing session: words of letters, some layer chords (prefix held plus mapped keys),
+ * globally mapped keys and held keys that autorepeat.
+ */
+vector<input_event> synthetic_events(size_t count, uint32_t seed) {
+    const char *letters[] = {"A", "B", "C", "D", "E", "G", "H", "I", "J", "K", "L", "M", "O", "P", "R", "S", "T",
+                             "U", "V", "W", "Y"};
+    const char *layer_keys[] = {"H", "J", "K", "L", "U", "P", "I", "O", "G"};
+    auto random = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return seed >> 8;
+    };
+    auto tap = [](vector<input_event> &events, int code) {
+        events.push_back(key_event(code, 1));
+        events.push_back(key_event(code, 0));
+    };
+
+    vector<input_event> events;
+    while (events.size() < count) {
+        auto kind = random() % 10;
+        if (kind < 6) {
+            for (auto i = 0u, n = 2 + random() % 6; i < n; i++) {
+                tap(events, parse_key(letters[random() % (sizeof(letters) / sizeof(letters[0]))]));
+            }
+            tap(events, KEY_SPACE);
+        } else if (kind < 8) {
+            auto prefix = random() % 2 ? KEY_F : KEY_N;
+            events.push_back(key_event(prefix, 1));
+            events.push_back(key_event(prefix, 2));
+            for (auto i = 0u, n = 1 + random() % 4; i < n; i++) {
+                tap(events, parse_key(layer_keys[random() % (sizeof(layer_keys) / sizeof(layer_keys[0]))]));
+            }
+            events.push_back(key_event(prefix, 0));
+        } else if (kind < 9) {
+            tap(events, random() % 2 ? KEY_CAPSLOCK : KEY_GRAVE);
+        } else {
+            auto code = parse_key(letters[random() % (sizeof(letters) / sizeof(letters[0]))]);
+            events.push_back(key_event(code, 1));
+            for (auto i = 0u, n = 5 + random() % 20; i < n; i++) {
+                events.push_back(key_event(code, 2));
+            }
+            events.push_back(key_event(code, 0));
+        }
+    }
+    events.resize(count);
+    return events;
+}
+
+// raw input_events as written by `intercept`, only the key events are kept
+vector<input_event> recorded_events(const string &file) {
+    ifstream in(file, ios::binary);
+    if (!in) {
+        throw runtime_error("can not open " + file);
+    }
+    vector<input_event> events;
+    input_event event;
+    while (in.read(reinterpret_cast<char *>(&event), sizeof(event))) {
+        if (event.type == EV_KEY) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+struct Percentiles {
+    uint64_t p50, p99, p999, max;
+};
+
+// zeros without samples
+Percentiles percentiles(vector<uint64_t> &samples) {
+    if (samples.empty()) {
+        return {0, 0, 0, 0};
+    }
+    sort(samples.begin(), samples.end());
+    auto at = [&](double q) { return samples[min(samples.size() - 1, size_t(q * samples.size()))]; };
+    return {at(0.5), at(0.99), at(0.999), samples.back()};
+}
+
+void print(const string &name, const Percentiles &p, const string &unit) {
+    cout << "  " << name << " (" << unit << ")  p50 " << p.p50 << "  p99 " << p.p99 << "  p99.9 " << p.p999
+         << "  max " << p.max << endl;
+}
+
+void bench_in_process(const string &config_file, const vector<input_event> &events, int rounds) {
+    auto config = read_config(config_file);
+    auto state = build_state(config);
+    OutputBuffer<> out;
+
+    // warm up: every code has been seen and the tables are in the cache
+    for (const auto &e: events) {
+        out.clear();
+        process(config, state, e, out);
+    }
+
+    vector<uint64_t> latencies;
+    latencies.reserve(events.size() * rounds);
+    size_t written = 0;
+    auto allocations_before = allocations.load();
+    for (int r = 0; r < rounds; r++) {
+        for (const auto &e: events) {
+            out.clear();
+            auto start = now_ns();
+            written += process(config, state, e, out);
+            latencies.push_back(now_ns() - start);
+        }
+    }
+    auto allocated = allocations.load() - allocations_before;
+
+    // throughput without the clock reads in between
+    auto start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (const auto &e: events) {
+            out.clear();
+            written += process(config, state, e, out);
+        }
+    }
+    auto elapsed = now_ns() - start;
+
+    auto total = events.size() * rounds;
+    cout << "in-process: " << total << " key events, " << fixed << setprecision(2) << double(written) / 2 / total
+         << " output events per input" << endl;
+    auto p = percentiles(latencies);
+    print("latency", p, "ns/event");
+    cout << "  throughput " << total * 1e3 / elapsed << " M events/s" << endl;
+    cout << "  allocations/event " << setprecision(4) << double(allocated) / total << endl;
+}
+
+template<typename F>
+double throughput(const vector<input_event> &events, int rounds, F f) {
+    OutputBuffer<> out;
+    for (const auto &e: events) {
+        out.clear();
+        f(e, out);
+    }
+    auto start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (const auto &e: events) {
+            out.clear();
+            f(e, out);
+        }
+    }
+    return double(events.size()) * rounds * 1e3 / (now_ns() - start);
+}
+
+// the keymap schoenberg_gen compiled into the benchmark against the same keymap interpreted, both through process
+void bench_compiled(const vector<input_event> &events, int rounds) {
+    Engine compiled(generated::config());
+    Engine interpreted(read_config(generated::SOURCE));
+    auto fast = throughput(events, rounds, [&](const input_event &e, OutputSpan &out) {
+        process(compiled.config, compiled.state, e, out);
+    });
+    auto slow = throughput(events, rounds, [&](const input_event &e, OutputSpan &out) {
+        process(interpreted.config, interpreted.state, e, out);
+    });
+    cout << "compiled keymap (" << generated::SOURCE << "): " << fixed << setprecision(2) << fast
+         << " M events/s, interpreted " << slow << " M events/s, " << fast / slow << "x" << endl;
+}
+
+// frames as the kernel sends them: scan code, key, sync
+vector<input_event> frames(const vector<input_event> &events) {
+    vector<input_event> res;
+    for (const auto &e: events) {
+        res.push_back(input_event{.type = EV_MSC, .code = MSC_SCAN, .value = e.code});
+        res.push_back(e);
+        res.push_back(input_event{.type = EV_SYN, .code = SYN_REPORT, .value = 0});
+    }
+    return res;
+}
+
+// the key frames with pointer motion frames in between, as from a keyboard with a touchpad
+vector<input_event> with_motion(const vector<input_event> &key_frames, int motion) {
+    vector<input_event> res;
+    for (const auto &e: key_frames) {
+        res.push_back(e);
+        if (e.type == EV_SYN) {
+            for (int i = 0; i < motion; i++) {
+                res.push_back(input_event{.type = EV_REL, .code = REL_X, .value = 1});
+                res.push_back(input_event{.type = EV_REL, .code = REL_Y, .value = -1});
+                res.push_back(input_event{.type = EV_SYN, .code = SYN_REPORT, .value = 0});
+            }
+        }
+    }
+    return res;
+}
+
+// the frames through process_batch, against the same done one event at a time
+void bench_batch(const string &config_file, const vector<input_event> &input, int rounds, const string &name) {
+    auto config = read_config(config_file);
+    auto output = make_unique<OutputBuffer<BATCH_OUTPUT_EVENTS>>();
+    auto &out = *output;
+
+    auto single = [&]() {
+        auto state = build_state(config);
+        size_t written = 0;
+        for (int r = 0; r < rounds; r++) {
+            out.clear();
+            for (const auto &e: input) {
+                if (out.capacity - out.size() < MAX_OUTPUT_EVENTS) {
+                    written += out.size();
+                    out.clear();
+                }
+                if (e.type == EV_MSC && e.code == MSC_SCAN) {
+                    continue;
+                }
+                if (e.type != EV_KEY) {
+                    out.push(e);
+                    continue;
+                }
+                auto start = out.size();
+                process(config, state, e, out);
+                // like write_frames, the output has the timestamp of its source
+                for (auto i = start; i < out.size(); i++) {
+                    out.events[i].time = e.time;
+                }
+            }
+            written += out.size();
+        }
+        return written;
+    };
+    auto batch = [&]() {
+        auto state = build_state(config);
+        size_t written = 0;
+        for (int r = 0; r < rounds; r++) {
+            BatchFrame frame;
+            for (size_t taken = 0; taken < input.size();) {
+                out.clear();
+                taken += process_batch(config, state, input.data() + taken, input.size() - taken, out, frame);
+                written += out.size();
+            }
+        }
+        return written;
+    };
+
+    // warm up the caches
+    single();
+    batch();
+    auto start = now_ns();
+    auto single_written = single();
+    auto single_elapsed = now_ns() - start;
+    start = now_ns();
+    auto batch_written = batch();
+    auto batch_elapsed = now_ns() - start;
+
+    auto total = input.size() * rounds;
+    cout << "batch, " << name << ": " << total << " input events" << endl;
+    cout << "  one by one " << fixed << setprecision(2) << total * 1e3 / single_elapsed << " M events/s, "
+         << single_written << " written" << endl;
+    cout << "  batch      " << total * 1e3 / batch_elapsed << " M events/s, " << batch_written << " written" << endl;
+}
+
+pid_t spawn(const string &run, const string &config_file, int &in, int &out) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) || pipe(from_child)) {
+        throw runtime_error("pipe failed");
+    }
+    auto pid = fork();
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[0]), close(to_child[1]), close(from_child[0]), close(from_child[1]);
+        execl(run.c_str(), run.c_str(), config_file.c_str(), (char *) nullptr);
+        _exit(127);
+    }
+    close(to_child[0]), close(from_child[1]);
+    in = to_child[1];
+    out = from_child[0];
+    return pid;
+}
+
+// reads up to and including the next count SYN_REPORTs, false on end of file or when nothing arrives
+// within timeout_ms
+bool read_frames(EventReader &reader, int fd, size_t count = 1, int timeout_ms = -1) {
+    input_event event;
+    while (true) {
+        while (reader.pop(event)) {
+            if (event.type == EV_SYN && event.code == SYN_REPORT && --count == 0) {
+                return true;
+            }
+        }
+        pollfd ready{fd, POLLIN, 0};
+        if (poll(&ready, 1, timeout_ms) <= 0 || !reader.fill()) {
+            return false;
+        }
+    }
+}
+
+void bench_end_to_end(const string &run, const string &config_file, const vector<input_event> &events) {
+    auto input = frames(events);
+    int in, out;
+
+    // round trip: one frame at a time, wait for all of its output to come out.
+    // an input frame can come out as several frames (a mod and its key, a prefix tap and the key after it),
+    // each with its SYN_REPORT, and one the engine swallows (a prefix press) writes nothing at all. an engine
+    // of the same config tells how many to wait for. the timeout covers the ones it decides differently
+    Engine expected(read_config(config_file));
+    OutputBuffer<> output;
+    auto pid = spawn(run, config_file, in, out);
+    {
+        EventReader reader(out);
+        vector<uint64_t> latencies;
+        size_t swallowed = 0, lost = 0;
+        for (size_t i = 0; i < input.size(); i += 3) {
+            output.clear();
+            process(expected.config, expected.state, input[i + 1], output);
+            auto start = now_ns();
+            if (write(in, &input[i], 3 * sizeof(input_event)) != 3 * sizeof(input_event)) {
+                throw runtime_error(run + " stopped");
+            }
+            size_t frames = 0;
+            output.for_each_frame([&](const input_event *, size_t count) { frames += count > 0; });
+            if (!frames) {
+                swallowed++;
+                continue;
+            }
+            if (!read_frames(reader, out, frames, 1000)) {
+                lost++;
+                continue;
+            }
+            latencies.push_back(now_ns() - start);
+        }
+        close(in);
+        cout << "end-to-end: " << latencies.size() << " frames through " << run << ", " << swallowed
+             << " swallowed";
+        if (lost) {
+            cout << ", " << lost << " without output";
+        }
+        cout << endl;
+        auto p = percentiles(latencies);
+        print("round trip", p, "ns/frame");
+    }
+    close(out);
+    waitpid(pid, nullptr, 0);
+
+    // throughput: stream everything and count the frames that come back
+    pid = spawn(run, config_file, in, out);
+    auto start = now_ns();
+    thread writer([&]() {
+        auto bytes = reinterpret_cast<const char *>(input.data());
+        size_t length = input.size() * sizeof(input_event);
+        while (length > 0) {
+            auto res = write(in, bytes, length);
+            if (res <= 0) {
+                break;
+            }
+            bytes += res, length -= res;
+        }
+        close(in);
+    });
+    EventReader reader(out);
+    size_t count = 0;
+    while (read_frames(reader, out)) {
+        count++;
+    }
+    auto elapsed = now_ns() - start;
+    writer.join();
+    close(out);
+    waitpid(pid, nullptr, 0);
+    cout << "  throughput " << fixed << setprecision(1) << count * 1e9 / elapsed << " frames/s" << endl;
+}
+
+void usage(const char *name) {
+    cerr << "usage: " << name << " [--config FILE] [--input FILE] [--events N] [--rounds N] [--e2e] [--run PATH]"
+         << endl;
+    cerr << "  --config FILE  keymap to benchmark (default tst/test.yaml)" << endl;
+    cerr << "  --input FILE   replay raw input_events (as written by intercept) instead of synthetic typing" << endl;
+    cerr << "  --events N     number of synthetic key events (default 100000)" << endl;
+    cerr << "  --rounds N     how often the events are replayed in-process (default 10)" << endl;
+    cerr << "  --e2e          also pipe the events through schoenberg_run" << endl;
+    cerr << "  --run PATH     schoenberg_run binary for --e2e" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    static option options[] = {
+            {"config", required_argument, nullptr, 'c'},
+            {"input",  required_argument, nullptr, 'i'},
+            {"events", required_argument, nullptr, 'n'},
+            {"rounds", required_argument, nullptr, 'r'},
+            {"e2e",    no_argument,       nullptr, 'e'},
+            {"run",    required_argument, nullptr, 'p'},
+            {"help",   no_argument,       nullptr, 'h'},
+            {nullptr, 0,                  nullptr, 0},
+    };
+    string config_file = "tst/test.yaml";
+    string input_file;
+    string run = SCHOENBERG_RUN;
+    size_t count = 100000;
+    int rounds = 10;
+    bool e2e = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:i:n:r:ep:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'c':
+                config_file = optarg;
+                break;
+            case 'i':
+                input_file = optarg;
+                break;
+            case 'n':
+                count = stoul(optarg);
+                break;
+            case 'r':
+                rounds = stoi(optarg);
+                break;
+            case 'e':
+                e2e = true;
+                break;
+            case 'p':
+                run = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    auto events = input_file.empty() ? synthetic_events(count, 42) : recorded_events(input_file);
+    if (events.empty()) {
+        cerr << "no key events to replay" << endl;
+        return 1;
+    }
+    bench_in_process(config_file, events, rounds);
+    bench_compiled(events, rounds);
+    bench_batch(config_file, frames(events), rounds, "key frames");
+    bench_batch(config_file, with_motion(frames(events), 4), rounds, "with pointer motion");
+    if (e2e) {
+        bench_end_to_end(run, config_file, events);
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include "schoenberg.h"
+#include "log.h"
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+#endif
+
+using namespace schoenberg;
+
+namespace {
+
+    // type and code of an event as one 32 bit word, as the gather loads them
+    constexpr uint32_t type_code(int type, int code) {
+        return uint32_t(type) | uint32_t(code) << 16;
+    }
+
+    constexpr uint32_t SCAN = type_code(EV_MSC, MSC_SCAN);
+    constexpr uint32_t SYN = type_code(EV_SYN, SYN_REPORT);
+
+#if defined(__x86_64__)
+
+    static_assert(sizeof(input_event) == 24 && offsetof(input_event, type) == 16 &&
+                  offsetof(input_event, code) == 18, "the gather offsets assume the 64 bit input_event");
+
+    __attribute__((target("avx2")))
+    void classify_avx2(const input_event *events, size_t count, uint64_t &keys, uint64_t &scans, uint64_t &syns) {
+        keys = scans = syns = 0;
+        auto base = reinterpret_cast<const int *>(events);
+        // byte offsets of type and code in eight consecutive events
+        const auto offsets = _mm256_setr_epi32(16, 40, 64, 88, 112, 136, 160, 184);
+        const auto type_mask = _mm256_set1_epi32(0xffff);
+        const auto key = _mm256_set1_epi32(EV_KEY);
+        const auto scan = _mm256_set1_epi32(SCAN);
+        const auto syn = _mm256_set1_epi32(SYN);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            auto words = _mm256_i32gather_epi32(base + i * sizeof(input_event) / sizeof(int), offsets, 1);
+            auto is_key = _mm256_cmpeq_epi32(_mm256_and_si256(words, type_mask), key);
+            auto is_scan = _mm256_cmpeq_epi32(words, scan);
+            auto is_syn = _mm256_cmpeq_epi32(words, syn);
+            keys |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(is_key))) << i;
+            scans |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(is_scan))) << i;
+            syns |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(is_syn))) << i;
+        }
+        uint64_t tail_keys, tail_scans, tail_syns;
+        classify_scalar(events + i, count - i, tail_keys, tail_scans, tail_syns);
+        keys |= tail_keys << i;
+        scans |= tail_scans << i;
+        syns |= tail_syns << i;
+    }
+
+    const bool HAS_AVX2 = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }();
+
+#endif
+
+    template<typename Log>
+    size_t run_key(Config &config, State &state, const input_event &event, OutputSpan &out, Log &log) {
+        auto start = out.size();
+        process(config, state, event, out, log);
+        for (auto i = start; i < out.size(); i++) {
+            out.events[i].time = event.time;
+        }
+        return out.size() - start;
+    }
+
+}
+
+void schoenberg::classify_scalar(const input_event *events, size_t count, uint64_t &keys, uint64_t &scans,
+                                 uint64_t &syns) {
+    keys = scans = syns = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto word = type_code(events[i].type, events[i].code);
+        keys |= uint64_t(events[i].type == EV_KEY) << i;
+        scans |= uint64_t(word == SCAN) << i;
+        syns |= uint64_t(word == SYN) << i;
+    }
+}
+
+void schoenberg::classify(const input_event *events, size_t count, uint64_t &keys, uint64_t &scans,
+                          uint64_t &syns) {
+#if defined(__x86_64__)
+    if (HAS_AVX2) {
+        classify_avx2(events, count, keys, scans, syns);
+        return;
+    }
+#endif
+    classify_scalar(events, count, keys, scans, syns);
+}
+
+// the bits above i
+inline uint64_t above(size_t i) {
+    return i >= 63 ? 0 : ~uint64_t(0) << (i + 1);
+}
+
+inline uint64_t lowest(uint64_t bits) {
+    return bits & -bits;
+}
+
+/**
+ * only keys, scan codes and the SYN_REPORT that ends a frame with them are looked at one by one.
+ * everything in between, frames without keys included, is copied as a run.
+ */
+template<typename Log, typename>
+size_t schoenberg::process_batch(Config &config, State &state, const input_event *events, size_t count,
+                                 OutputSpan &out, BatchFrame &frame, Log log) {
+    size_t taken = 0;
+    while (taken < count) {
+        auto length = std::min(count - taken, size_t(64));
+        auto chunk = events + taken;
+        uint64_t keys, scans, syns;
+        classify(chunk, length, keys, scans, syns);
+        auto marked = keys | scans;
+        if (frame.keys) {
+            marked |= lowest(syns);
+        }
+
+        size_t i = 0;
+        while (i < length) {
+            auto next = marked ? size_t(__builtin_ctzll(marked)) : length;
+            if (next > i) {
+                auto run = std::min(next - i, out.capacity - out.size());
+                out.push(chunk + i, run);
+                // what counts is whether the frame the run ends in has events already
+                auto run_syns = run ? syns & ~above(i + run - 1) & (above(i) | uint64_t(1) << i) : 0;
+                if (run_syns) {
+                    frame.written = 63 - __builtin_clzll(run_syns) < int(i + run - 1);
+                } else {
+                    frame.written |= run > 0;
+                }
+                i += run;
+                if (i < next) {
+                    return taken + i;
+                }
+                continue;
+            }
+            marked &= marked - 1;
+
+            if (keys >> i & 1) {
+                if (out.capacity - out.size() < MAX_OUTPUT_EVENTS) {
+                    return taken + i;
+                }
+                frame.written |= run_key(config, state, chunk[i], out, log) > 0;
+            } else if (scans >> i & 1) {
+                // nothing to do, it is dropped
+            } else {
+                if (out.size() == out.capacity) {
+                    return taken + i;
+                }
+                // the SYN_REPORT of a frame the engine swallowed completely (a prefix press) is dropped as well
+                if (frame.written) {
+                    out.push(chunk[i]);
+                }
+                frame = BatchFrame();
+                i++;
+                continue;
+            }
+            if (!frame.keys) {
+                frame.keys = true;
+                marked |= lowest(syns & above(i));
+            }
+            i++;
+        }
+        taken += length;
+    }
+    return taken;
+}
+
+template size_t schoenberg::process_batch(Config &, State &, const input_event *, size_t, OutputSpan &,
+                                          BatchFrame &, NoLog);
+
+template size_t schoenberg::process_batch(Config &, State &, const input_event *, size_t, OutputSpan &,
+                                          BatchFrame &, StreamLog);
+
+template size_t schoenberg::process_batch(Config &, State &, const input_event *, size_t, OutputSpan &,
+                                          BatchFrame &, TraceLog);
@@ -0,0 +1,225 @@
+#include "cache.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+static_assert(std::is_trivially_copyable<KeyTable>::value, "key tables are stored as they are in memory");
+
+namespace {
+
+    constexpr char MAGIC[8] = {'S', 'C', 'H', 'B', 'C', 'F', 'G', '\0'};
+    // bump whenever the layout of the cache or of the tables in it changes
+    constexpr uint32_t VERSION = 5;
+
+    struct CacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t key_count;
+        uint32_t table_size;
+        uint32_t layer_count;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        uint64_t size;
+        uint64_t hash;
+    };
+
+    // the scalar settings of the config
+    struct CacheOptions {
+        uint32_t tapping_term;
+        uint32_t permissive_hold;
+        uint32_t combo_term;
+        uint32_t combo_count;
+        uint32_t repeat_rate;
+        uint32_t repeat_delay;
+    };
+
+    // the combos are stored as written in the yaml and compiled again on load
+    struct CacheCombo {
+        int16_t keys[ComboMachine::MAX_KEYS];
+        KeyTarget target;
+    };
+
+    struct CacheLayer {
+        char prefix[32];
+        uint32_t toggle;
+        KeyTable keys;
+    };
+
+    // what identifies the yaml a cache was compiled from
+    struct Source {
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        uint64_t size;
+        uint64_t hash;
+    };
+
+    // FNV-1a
+    uint64_t hash_bytes(const string &bytes) {
+        uint64_t hash = 14695981039346656037ull;
+        for (auto c: bytes) {
+            hash = (hash ^ (unsigned char) c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool read_source(const string &config_file, Source &source) {
+        struct stat info;
+        if (stat(config_file.c_str(), &info) != 0) {
+            return false;
+        }
+        std::ifstream in(config_file, std::ios::binary);
+        std::stringstream content;
+        content << in.rdbuf();
+        source = {info.st_mtim.tv_sec, info.st_mtim.tv_nsec, (uint64_t) info.st_size, hash_bytes(content.str())};
+        return (bool) in;
+    }
+
+    CacheHeader header_for(const Source &source, uint32_t layer_count) {
+        CacheHeader header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.key_count = KEY_CNT;
+        header.table_size = sizeof(KeyTable);
+        header.layer_count = layer_count;
+        header.mtime_sec = source.mtime_sec;
+        header.mtime_nsec = source.mtime_nsec;
+        header.size = source.size;
+        header.hash = source.hash;
+        return header;
+    }
+
+}
+
+string schoenberg::cache_file(const string &config_file) {
+    return config_file + ".cache";
+}
+
+void schoenberg::write_cache(const string &config_file) {
+    Source source;
+    if (!read_source(config_file, source)) {
+        throw std::runtime_error("can not read " + config_file);
+    }
+    auto config = read_config(config_file);
+    auto header = header_for(source, config.layers.size());
+
+    // written next to the cache and renamed, so a running schoenberg never sees half a file
+    auto target = cache_file(config_file);
+    auto temp = target + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        CacheOptions options{config.tapping_term, config.permissive_hold, config.combo_term,
+                             (uint32_t) config.combos.size(), config.repeat_rate, config.repeat_delay};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(&options), sizeof(options));
+        out.write(reinterpret_cast<const char *>(&config.keys), sizeof(config.keys));
+        for (const auto &layer: config.layers) {
+            CacheLayer cached{};
+            if (layer.prefix.size() >= sizeof(cached.prefix)) {
+                throw std::runtime_error("prefix name too long: " + layer.prefix);
+            }
+            strncpy(cached.prefix, layer.prefix.c_str(), sizeof(cached.prefix) - 1);
+            cached.toggle = layer.toggle;
+            cached.keys = layer.keys;
+            out.write(reinterpret_cast<const char *>(&cached), sizeof(cached));
+        }
+        for (const auto &combo: config.combos) {
+            // a key written twice in the yaml is in the combo once
+            vector<int> keys;
+            for (auto key: combo.keys) {
+                if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+                    keys.push_back(key);
+                }
+            }
+            CacheCombo cached{};
+            if (keys.size() > std::size(cached.keys)) {
+                throw std::runtime_error("too many keys in a combo");
+            }
+            std::fill(std::begin(cached.keys), std::end(cached.keys), -1);
+            std::copy(keys.begin(), keys.end(), cached.keys);
+            cached.target = combo.target;
+            out.write(reinterpret_cast<const char *>(&cached), sizeof(cached));
+        }
+        if (!out) {
+            throw std::runtime_error("can not write " + temp);
+        }
+    }
+    if (rename(temp.c_str(), target.c_str()) != 0) {
+        throw std::runtime_error("can not write " + target + ": " + strerror(errno));
+    }
+}
+
+std::optional<Config> schoenberg::read_cache(const string &config_file) {
+    auto fd = open(cache_file(config_file).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat info;
+    auto ok = fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(CacheHeader);
+    auto mapped = ok ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return std::nullopt;
+    }
+
+    std::optional<Config> res;
+    auto bytes = static_cast<const char *>(mapped);
+    auto header = reinterpret_cast<const CacheHeader *>(bytes);
+    Source source;
+    if (read_source(config_file, source)) {
+        auto expected = header_for(source, header->layer_count);
+        auto options = reinterpret_cast<const CacheOptions *>(bytes + sizeof(CacheHeader));
+        auto size = sizeof(CacheHeader) + sizeof(CacheOptions) + sizeof(KeyTable) +
+                    header->layer_count * sizeof(CacheLayer);
+        auto valid = memcmp(header, &expected, sizeof(CacheHeader)) == 0 && (size_t) info.st_size >= size;
+        if (valid) {
+            size += options->combo_count * sizeof(CacheCombo);
+            valid = (size_t) info.st_size == size;
+        }
+        if (valid) {
+            auto keys = reinterpret_cast<const KeyTable *>(bytes + sizeof(CacheHeader) + sizeof(CacheOptions));
+            auto layers = reinterpret_cast<const CacheLayer *>(bytes + sizeof(CacheHeader) + sizeof(CacheOptions) +
+                                                               sizeof(KeyTable));
+            vector<LayerConfig> output_layers;
+            output_layers.reserve(header->layer_count);
+            for (uint32_t i = 0; i < header->layer_count; i++) {
+                output_layers.emplace_back(string(layers[i].prefix), layers[i].keys);
+                output_layers.back().toggle = layers[i].toggle;
+            }
+            res.emplace(output_layers, *keys);
+            res->tapping_term = options->tapping_term;
+            res->permissive_hold = options->permissive_hold;
+            res->combo_term = options->combo_term;
+            res->repeat_rate = options->repeat_rate;
+            res->repeat_delay = options->repeat_delay;
+            auto combos = reinterpret_cast<const CacheCombo *>(layers + header->layer_count);
+            for (uint32_t i = 0; i < options->combo_count; i++) {
+                vector<int> keys;
+                for (auto key: combos[i].keys) {
+                    if (key >= 0) {
+                        keys.push_back(key);
+                    }
+                }
+                res->combos.emplace_back(keys, combos[i].target);
+            }
+            res->machine = compile_combos(res->combos);
+        }
+    }
+    munmap(mapped, info.st_size);
+    return res;
+}
+
+Config schoenberg::load_config(const string &config_file) {
+    if (auto cached = read_cache(config_file)) {
+        return *cached;
+    }
+    return read_config(config_file);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "schoenberg.h"
+#include <optional>
+#include <string>
+
+namespace schoenberg {
+
+    /**
+     * the compiled config is stored next to the yaml file (config.yaml -> config.yaml.cache).
+     * it holds the key tables in their in-memory layout, so loading it is a mmap and a copy
+     * instead of parsing yaml and looking up key names.
+     * a cache is only used while the yaml has the same mtime, size and content hash as when it was written.
+     */
+    std::string cache_file(const std::string &config_file);
+
+    // compiles config_file into its cache, throws on failure
+    void write_cache(const std::string &config_file);
+
+    // the config from the cache, nothing if there is no cache or it does not match the yaml anymore
+    std::optional<Config> read_cache(const std::string &config_file);
+
+    // from the cache if it is valid, otherwise from the yaml
+    Config load_config(const std::string &config_file);
+
+};
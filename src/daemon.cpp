@@ -0,0 +1,212 @@
+#include "daemon.h"
+#include "pipeline.h"
+#include "realtime.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
+
+using namespace schoenberg;
+
+int open_device(const std::string &path) {
+    auto fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("can not open " + path + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+// the timestamps of the device on the clock the latency stats read, instead of the wall clock that can jump.
+// the clock they stay on if the device does not take it
+clockid_t monotonic_timestamps(int fd) {
+    int clock = CLOCK_MONOTONIC;
+    return ioctl(fd, EVIOCSCLOCKID, &clock) == 0 ? CLOCK_MONOTONIC : CLOCK_REALTIME;
+}
+
+// the virtual device has to be able to send every key the config can produce
+void enable_output_keys(libevdev *evdev, const Config &config) {
+    libevdev_enable_event_type(evdev, EV_KEY);
+    auto enable = [&](const KeyTarget &target) {
+        if (target.mapped()) {
+            libevdev_enable_event_code(evdev, EV_KEY, target.key, nullptr);
+        }
+        if (target.mod > 0) {
+            libevdev_enable_event_code(evdev, EV_KEY, target.mod, nullptr);
+        }
+    };
+    auto enable_table = [&](const KeyTable &keys) {
+        for (int code = 0; code < KEY_CNT; code++) {
+            enable(keys.lookup(code));
+        }
+    };
+    enable_table(config.keys);
+    for (const auto &layer: config.layers) {
+        enable_table(layer.keys);
+    }
+    for (const auto &combo: config.combos) {
+        enable(combo.target);
+    }
+}
+
+Device::Device(const std::string &path, const Profiles &profiles) : path(path), fd(open_device(path)),
+                                                                   clock(monotonic_timestamps(fd)),
+                                                                   engines(profiles), reader(fd) {
+    auto res = libevdev_new_from_fd(fd, &evdev);
+    if (res < 0) {
+        close(fd);
+        throw std::runtime_error("can not read " + path + ": " + strerror(-res));
+    }
+    for (size_t i = 0; i < profiles.size(); i++) {
+        enable_output_keys(evdev, profiles.config(i));
+    }
+    res = libevdev_uinput_create_from_device(evdev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uinput);
+    if (res < 0) {
+        libevdev_free(evdev);
+        close(fd);
+        throw std::runtime_error("can not create a uinput device for " + path + ": " + strerror(-res));
+    }
+    res = libevdev_grab(evdev, LIBEVDEV_GRAB);
+    if (res < 0) {
+        libevdev_uinput_destroy(uinput);
+        libevdev_free(evdev);
+        close(fd);
+        throw std::runtime_error("can not grab " + path + ": " + strerror(-res));
+    }
+    writer = std::make_unique<EventWriter>(libevdev_uinput_get_fd(uinput));
+}
+
+Device::~Device() {
+    libevdev_grab(evdev, LIBEVDEV_UNGRAB);
+    libevdev_uinput_destroy(uinput);
+    libevdev_free(evdev);
+    close(fd);
+}
+
+Daemon::Daemon(const Profiles &profiles, std::ostream &errors) : profiles(profiles), errors(errors) {
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    signals = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, signals, &event);
+}
+
+Daemon::~Daemon() {
+    devices.clear();
+    close(signals);
+    close(epoll);
+}
+
+void Daemon::add_device(const std::string &path) {
+    auto device = std::make_unique<Device>(path, profiles);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &device->input_source;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, device->fd, &event) < 0) {
+        throw std::runtime_error("can not watch " + path + ": " + strerror(errno));
+    }
+    event.data.ptr = &device->timer_source;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, device->timer.fd, &event) < 0) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, device->fd, nullptr);
+        throw std::runtime_error("can not watch the timer of " + path + ": " + strerror(errno));
+    }
+    if (device->clock != CLOCK_MONOTONIC) {
+        errors << "can not switch the timestamps of " << path << " to CLOCK_MONOTONIC, using CLOCK_REALTIME" << endl;
+    }
+    device->writer->measure(latency, device->clock);
+    devices.push_back(std::move(device));
+}
+
+void Daemon::measure(LatencyHistogram *histogram) {
+    latency = histogram;
+    for (const auto &device: devices) {
+        device->writer->measure(latency, device->clock);
+    }
+}
+
+void Daemon::remove_device(Device *device) {
+    errors << "device " << device->path << " is gone" << endl;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, device->fd, nullptr);
+    epoll_ctl(epoll, EPOLL_CTL_DEL, device->timer.fd, nullptr);
+    for (auto it = devices.begin(); it != devices.end(); ++it) {
+        if (it->get() == device) {
+            devices.erase(it);
+            return;
+        }
+    }
+}
+
+void Daemon::prefault() const {
+    for (const auto &device: devices) {
+        for (const auto &engine: device->engines.all()) {
+            schoenberg::prefault(*engine);
+        }
+    }
+}
+
+int Daemon::run() {
+    OutputBuffer<> output;
+    epoll_event events[16];
+
+    while (!devices.empty()) {
+        auto count = epoll_wait(epoll, events, 16, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errors << "epoll: " << strerror(errno) << endl;
+            return 1;
+        }
+        for (int i = 0; i < count; i++) {
+            auto source = static_cast<Device::Source *>(events[i].data.ptr);
+            if (!source) {
+                // SIGINT or SIGTERM, the destructors ungrab the devices
+                return 0;
+            }
+            if (!events[i].events) {
+                // the device is already gone
+                continue;
+            }
+            auto device = source->device;
+            auto expired = source->timer && device->timer.fired();
+
+            // the input first, it may be older than the deadline and decide differently
+            auto alive = device->reader.fill();
+            // another profile only takes over when nothing is held
+            auto &engine = *device->engines.select();
+            if (engine.state.timed()) {
+                // for events without a timestamp
+                engine.state.now = device->timer.now();
+            }
+            forward_ready(engine, device->reader, output, *device->writer, NoLog());
+            if (expired) {
+                forward_expired(engine, device->timer.now(), output, *device->writer, NoLog());
+            }
+            device->timer.arm(next_deadline(engine.state));
+            alive &= device->writer->flush();
+            if (!alive || (!source->timer && events[i].events & (EPOLLHUP | EPOLLERR))) {
+                // later events of this batch must not touch it anymore
+                for (int j = i + 1; j < count; j++) {
+                    if (events[j].data.ptr == &device->input_source || events[j].data.ptr == &device->timer_source) {
+                        events[j].events = 0;
+                    }
+                }
+                remove_device(device);
+            }
+        }
+    }
+    return 0;
+}
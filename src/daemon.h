@@ -0,0 +1,92 @@
+#pragma once
+
+#include "schoenberg.h"
+#include "io.h"
+#include "profile.h"
+#include "stats.h"
+#include "timer.h"
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct libevdev;
+struct libevdev_uinput;
+
+namespace schoenberg {
+
+    /**
+     * one grabbed evdev device, its virtual uinput twin and the engine state for it, one per profile.
+     */
+    class Device {
+    public:
+        // what an epoll event is about: the input of a device or its timer
+        class Source {
+        public:
+            Device *device;
+            bool timer;
+        };
+
+        Device(const std::string &path, const Profiles &profiles);
+
+        ~Device();
+
+        Device(const Device &) = delete;
+
+        Device &operator=(const Device &) = delete;
+
+        std::string path;
+        int fd = -1;
+        // of the event timestamps, CLOCK_MONOTONIC unless the device does not take it
+        clockid_t clock;
+        libevdev *evdev = nullptr;
+        libevdev_uinput *uinput = nullptr;
+        ProfileEngines engines;
+        EventReader reader;
+        std::unique_ptr<EventWriter> writer;
+        // for the tapping term, on the clock of the event timestamps
+        DeadlineTimer timer{clock};
+        Source input_source{this, false};
+        Source timer_source{this, true};
+    };
+
+    /**
+     * single process replacement for one `intercept | schoenberg_run | uinput` pipeline per device:
+     * grabs the devices itself, multiplexes them with epoll and writes to one uinput device per input device.
+     * every device has its own State. the devices timestamp their events with CLOCK_MONOTONIC.
+     * each device switches to the requested profile on its own, once nothing is held on it.
+     */
+    class Daemon {
+    public:
+        Daemon(const Profiles &profiles, std::ostream &errors);
+
+        ~Daemon();
+
+        Daemon(const Daemon &) = delete;
+
+        Daemon &operator=(const Daemon &) = delete;
+
+        // grabs the device, throws if that is not possible
+        void add_device(const std::string &path);
+
+        // runs until every device is gone or SIGINT/SIGTERM arrives
+        int run();
+
+        // maps the tables of every device's engine, see prefault(const Engine &)
+        void prefault() const;
+
+        // records the latency of every written event, for the devices added so far and later ones
+        void measure(LatencyHistogram *histogram);
+
+    private:
+        void remove_device(Device *device);
+
+        const Profiles &profiles;
+        std::ostream &errors;
+        std::vector<std::unique_ptr<Device>> devices;
+        int epoll = -1;
+        int signals = -1;
+        LatencyHistogram *latency = nullptr;
+    };
+
+};
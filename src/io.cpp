@@ -0,0 +1,77 @@
+#include "io.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+bool EventReader::fill() {
+    iovec segments[2];
+    auto count = ring.free_segments(segments);
+    if (count == 0) {
+        return true;
+    }
+    while (true) {
+        auto res = readv(fd, segments, count);
+        if (res > 0) {
+            ring.tail += res;
+            return true;
+        }
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        // a non blocking descriptor with nothing to read is not the end
+        return res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+void EventReader::pass(size_t events, EventWriter &writer) {
+    auto length = events * sizeof(input_event);
+    if (recorder) {
+        for (size_t i = 0; i < events; i++) {
+            input_event event;
+            std::memcpy(&event, ring.buffer + (ring.head + i * sizeof(input_event)) % ring.CAPACITY, sizeof(event));
+            recorder->input(event);
+        }
+    }
+    auto start = ring.head % ring.CAPACITY;
+    auto first = std::min(length, ring.CAPACITY - start);
+    writer.push(ring.buffer + start, first);
+    if (length > first) {
+        writer.push(ring.buffer, length - first);
+    }
+    ring.head += length;
+}
+
+void EventWriter::record(const char *events, size_t length) {
+    for (size_t offset = 0; offset + sizeof(input_event) <= length; offset += sizeof(input_event)) {
+        input_event event;
+        std::memcpy(&event, events + offset, sizeof(event));
+        recorder->output(event);
+    }
+}
+
+bool EventWriter::flush() {
+    if (latency && ring.head % sizeof(input_event) == 0) {
+        timespec now;
+        clock_gettime(clock, &now);
+        ring.for_each([&](const input_event &event) {
+            latency->record_since(event.time, now);
+        });
+    }
+    while (ring.used() > 0) {
+        iovec segments[2];
+        auto count = ring.used_segments(segments);
+        auto res = writev(fd, segments, count);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ring.head = ring.tail;
+            return false;
+        }
+        ring.head += res;
+    }
+    return true;
+}
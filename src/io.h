@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <time.h>
+#include <sys/uio.h>
+#include <linux/input.h>
+#include "record.h"
+
+namespace schoenberg {
+
+    /**
+     * byte ring holding input_events, sized in whole events.
+     * head and tail only ever grow, the position in the buffer is taken modulo the capacity.
+     * partial events (a short read from a pipe) simply stay in the ring until the rest arrives.
+     * the capacity is a multiple of the event size, so a complete event at an event aligned head never wraps.
+     */
+    template<size_t EVENTS>
+    class EventRing {
+    public:
+        static constexpr size_t CAPACITY = EVENTS * sizeof(input_event);
+
+        alignas(input_event) char buffer[CAPACITY];
+        size_t head = 0;
+        size_t tail = 0;
+
+        size_t used() const { return tail - head; }
+
+        size_t free() const { return CAPACITY - used(); }
+
+        // the free space as (at most) two iovecs, for readv
+        int free_segments(iovec segments[2]) {
+            auto start = tail % CAPACITY;
+            auto length = free();
+            auto first = std::min(length, CAPACITY - start);
+            segments[0] = {buffer + start, first};
+            segments[1] = {buffer, length - first};
+            return segments[1].iov_len ? 2 : (first ? 1 : 0);
+        }
+
+        // the used space as (at most) two iovecs, for writev
+        int used_segments(iovec segments[2]) {
+            auto start = head % CAPACITY;
+            auto length = used();
+            auto first = std::min(length, CAPACITY - start);
+            segments[0] = {buffer + start, first};
+            segments[1] = {buffer, length - first};
+            return segments[1].iov_len ? 2 : (first ? 1 : 0);
+        }
+
+        bool pop(input_event &event) {
+            if (used() < sizeof(input_event)) {
+                return false;
+            }
+            copy_out(reinterpret_cast<char *>(&event), sizeof(event));
+            return true;
+        }
+
+        // the next event without taking it
+        bool peek(input_event &event) const {
+            if (used() < sizeof(input_event)) {
+                return false;
+            }
+            auto start = head % CAPACITY;
+            auto first = std::min(sizeof(event), CAPACITY - start);
+            std::memcpy(&event, buffer + start, first);
+            std::memcpy(reinterpret_cast<char *>(&event) + first, buffer, sizeof(event) - first);
+            return true;
+        }
+
+        bool push(const input_event &event) {
+            if (free() < sizeof(input_event)) {
+                return false;
+            }
+            auto start = tail % CAPACITY;
+            auto first = std::min(sizeof(event), CAPACITY - start);
+            std::memcpy(buffer + start, &event, first);
+            std::memcpy(buffer, reinterpret_cast<const char *>(&event) + first, sizeof(event) - first);
+            tail += sizeof(event);
+            return true;
+        }
+
+        // raw bytes, e.g. a run of events copied from another ring
+        bool push(const char *data, size_t length) {
+            if (free() < length) {
+                return false;
+            }
+            auto start = tail % CAPACITY;
+            auto first = std::min(length, CAPACITY - start);
+            std::memcpy(buffer + start, data, first);
+            std::memcpy(buffer, data + first, length - first);
+            tail += length;
+            return true;
+        }
+
+        // the length in events of the next complete frame, up to and including its SYN_REPORT, 0 if the
+        // ring holds no complete frame. keys tells if the frame has events the engine has to see (keys)
+        // or drops (scan codes), a frame without them can be passed on as it is.
+        size_t frame(bool &keys) const {
+            keys = false;
+            auto position = head;
+            for (size_t count = 1; tail - position >= sizeof(input_event); count++) {
+                input_event event;
+                std::memcpy(&event, buffer + position % CAPACITY, sizeof(event));
+                keys |= event.type == EV_KEY || (event.type == EV_MSC && event.code == MSC_SCAN);
+                if (event.type == EV_SYN && event.code == SYN_REPORT) {
+                    return count;
+                }
+                position += sizeof(input_event);
+            }
+            return 0;
+        }
+
+        /**
+         * the complete frames that follow the head in one piece, without wrapping around the end of the buffer.
+         * returns their length in events, 0 if there is no such frame. the head has to be at an event boundary.
+         */
+        size_t frames(const input_event *&first) const {
+            auto start = head % CAPACITY;
+            first = reinterpret_cast<const input_event *>(buffer + start);
+            for (auto count = std::min(used(), CAPACITY - start) / sizeof(input_event); count > 0; count--) {
+                if (first[count - 1].type == EV_SYN && first[count - 1].code == SYN_REPORT) {
+                    return count;
+                }
+            }
+            return 0;
+        }
+
+        // drops events from the head, after they were taken with frames
+        void skip(size_t events) {
+            head += events * sizeof(input_event);
+        }
+
+        // calls f with every complete event, the head has to be at an event boundary
+        template<typename F>
+        void for_each(F f) const {
+            for (auto position = head; tail - position >= sizeof(input_event); position += sizeof(input_event)) {
+                input_event event;
+                std::memcpy(&event, buffer + position % CAPACITY, sizeof(event));
+                f(event);
+            }
+        }
+
+    private:
+        void copy_out(char *target, size_t length) {
+            auto start = head % CAPACITY;
+            auto first = std::min(length, CAPACITY - start);
+            std::memcpy(target, buffer + start, first);
+            std::memcpy(target + first, buffer, length - first);
+            head += length;
+        }
+    };
+
+    class EventWriter;
+
+    class LatencyHistogram;
+
+    /**
+     * reads input_events from a file descriptor with read(2)/readv(2).
+     * fill() blocks until at least one byte is there and then takes everything that is ready,
+     * on a non blocking descriptor it returns right away.
+     */
+    class EventReader {
+    public:
+        explicit EventReader(int fd) : fd(fd) {}
+
+        // returns false on end of file or a read error
+        bool fill();
+
+        bool pop(input_event &event) {
+            if (!ring.pop(event)) {
+                return false;
+            }
+            if (recorder) {
+                recorder->input(event);
+            }
+            return true;
+        }
+
+        bool peek(input_event &event) const { return ring.peek(event); }
+
+        // see EventRing::frame
+        size_t frame(bool &keys) const { return ring.frame(keys); }
+
+        // see EventRing::frames, the events stay valid until the next fill
+        size_t frames(const input_event *&first) const { return ring.frames(first); }
+
+        // takes the events returned by frames
+        void skip(size_t events) {
+            if (recorder) {
+                const input_event *first;
+                ring.frames(first);
+                for (size_t i = 0; i < events; i++) {
+                    recorder->input(first[i]);
+                }
+            }
+            ring.skip(events);
+        }
+
+        // hands the next events to the writer as they are, in one copy
+        void pass(size_t events, EventWriter &writer);
+
+        // every event taken from now on is appended to the trace as input
+        void record(Recorder *trace) { recorder = trace; }
+
+    private:
+        int fd;
+        EventRing<256> ring;
+        Recorder *recorder = nullptr;
+    };
+
+    /**
+     * collects output events and hands them to the kernel with a single writev(2) per flush.
+     * a full ring is flushed on push, so no event is ever dropped.
+     * with measure(), the latency of every event is recorded on flush: one clock read per flush, not per event.
+     */
+    class EventWriter {
+    public:
+        explicit EventWriter(int fd) : fd(fd) {}
+
+        void push(const input_event &event) {
+            if (recorder) {
+                recorder->output(event);
+            }
+            if (!ring.push(event)) {
+                flush();
+                ring.push(event);
+            }
+        }
+
+        // a run of events as raw bytes, a run longer than the ring is written in pieces
+        void push(const char *events, size_t length) {
+            if (recorder) {
+                record(events, length);
+            }
+            while (length > 0) {
+                if (!ring.free()) {
+                    flush();
+                }
+                auto piece = std::min(length, ring.free());
+                ring.push(events, piece);
+                events += piece;
+                length -= piece;
+            }
+        }
+
+        // returns false if the output is gone
+        bool flush();
+
+        // every event pushed from now on is appended to the trace as output
+        void record(Recorder *trace) { recorder = trace; }
+
+        // from now on every flush records the time since the source timestamp of each event
+        void measure(LatencyHistogram *histogram, clockid_t source_clock) {
+            latency = histogram;
+            clock = source_clock;
+        }
+
+    private:
+        int fd;
+        EventRing<256> ring;
+        LatencyHistogram *latency = nullptr;
+        clockid_t clock = CLOCK_REALTIME;
+        Recorder *recorder = nullptr;
+
+        void record(const char *events, size_t length);
+    };
+
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <linux/input.h>
+
+/**
+ * compile time tables between key names and codes.
+ * keycodes.def is generated by cmake from linux/input-event-codes.h, KEY_ names are listed without
+ * the prefix (ESC), BTN_ names with it (BTN_LEFT). the name -> code direction is a perfect hash
+ * (hash and displace) built by the compiler, the code -> name direction a dense array.
+ */
+namespace schoenberg::keycodes {
+
+    struct KeyName {
+        std::string_view name;
+        int code;
+        // defined as a number, not as an alias of another name
+        bool canonical;
+    };
+
+    constexpr KeyName KEYS[] = {
+#define SCHOENBERG_KEY(name, code, canonical) {name, code, canonical},
+
+#include "keycodes.def"
+
+#undef SCHOENBERG_KEY
+    };
+
+    constexpr size_t COUNT = sizeof(KEYS) / sizeof(KEYS[0]);
+    constexpr size_t BUCKETS = COUNT / 2 + 1;
+    constexpr size_t SLOTS = 2048;
+
+    static_assert(COUNT < SLOTS / 2, "the hash table needs room to stay sparse");
+
+    constexpr uint32_t hash(std::string_view name, uint32_t seed) {
+        uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+        for (auto c: name) {
+            h = (h ^ (unsigned char) c) * 16777619u;
+        }
+        h ^= h >> 15;
+        h *= 0x2c1b3c6du;
+        h ^= h >> 12;
+        return h;
+    }
+
+    struct PerfectHash {
+        // per bucket, the seed that puts all names of the bucket into free slots
+        std::array<uint16_t, BUCKETS> seeds{};
+        // index into KEYS, -1 for empty slots
+        std::array<int16_t, SLOTS> slots{};
+        bool ok = false;
+    };
+
+    constexpr PerfectHash build_hash() {
+        PerfectHash res;
+        for (auto &slot: res.slots) {
+            slot = -1;
+        }
+        // the names sorted by bucket
+        std::array<uint16_t, BUCKETS> sizes{};
+        std::array<uint16_t, BUCKETS + 1> starts{};
+        std::array<uint16_t, COUNT> order{};
+        for (size_t i = 0; i < COUNT; i++) {
+            sizes[hash(KEYS[i].name, 0) % BUCKETS]++;
+        }
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            starts[bucket + 1] = starts[bucket] + sizes[bucket];
+        }
+        auto next = starts;
+        for (size_t i = 0; i < COUNT; i++) {
+            order[next[hash(KEYS[i].name, 0) % BUCKETS]++] = i;
+        }
+
+        // the biggest buckets first, while the table is still empty
+        for (size_t size = 16; size > 0; size--) {
+            for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+                if (sizes[bucket] > 16) {
+                    return res;
+                }
+                if (sizes[bucket] != size) {
+                    continue;
+                }
+                auto placed = false;
+                std::array<uint16_t, 16> taken{};
+                for (uint16_t seed = 1; seed < 4096 && !placed; seed++) {
+                    placed = true;
+                    for (size_t i = 0; i < size && placed; i++) {
+                        auto slot = hash(KEYS[order[starts[bucket] + i]].name, seed) % SLOTS;
+                        placed = res.slots[slot] < 0;
+                        for (size_t j = 0; j < i && placed; j++) {
+                            placed = taken[j] != slot;
+                        }
+                        taken[i] = slot;
+                    }
+                    if (placed) {
+                        res.seeds[bucket] = seed;
+                        for (size_t i = 0; i < size; i++) {
+                            res.slots[taken[i]] = order[starts[bucket] + i];
+                        }
+                    }
+                }
+                if (!placed) {
+                    return res;
+                }
+            }
+        }
+        res.ok = true;
+        return res;
+    }
+
+    constexpr PerfectHash HASH = build_hash();
+
+    static_assert(HASH.ok, "no perfect hash for the key names");
+
+    // the key code for a name, -1 if there is no such key
+    constexpr int find(std::string_view name) {
+        auto seed = HASH.seeds[hash(name, 0) % BUCKETS];
+        auto index = HASH.slots[hash(name, seed) % SLOTS];
+        return index >= 0 && KEYS[index].name == name ? KEYS[index].code : -1;
+    }
+
+    constexpr std::array<std::string_view, KEY_CNT> build_names() {
+        std::array<std::string_view, KEY_CNT> res{};
+        // where several names share a code the last one is the specific name (BTN_MISC, BTN_0)
+        for (size_t i = 0; i < COUNT; i++) {
+            if (KEYS[i].canonical && KEYS[i].code >= 0 && KEYS[i].code < KEY_CNT) {
+                res[KEYS[i].code] = KEYS[i].name;
+            }
+        }
+        return res;
+    }
+
+    constexpr std::array<std::string_view, KEY_CNT> NAMES = build_names();
+
+    // the name of a key code, empty if the code has no name
+    constexpr std::string_view name(int code) {
+        return code >= 0 && code < KEY_CNT ? NAMES[code] : std::string_view();
+    }
+
+};
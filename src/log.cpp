@@ -0,0 +1,113 @@
+#include "log.h"
+#include "schoenberg.h"
+#include <chrono>
+#include <fstream>
+#include <time.h>
+
+using namespace schoenberg;
+
+const char *schoenberg::describe(LogTag tag) {
+    switch (tag) {
+        case LogTag::INPUT:
+            return "input";
+        case LogTag::MAPPING_MOD_BEFORE:
+            return "mapping: add mod before";
+        case LogTag::MAPPING_KEY:
+            return "mapping: mapped key";
+        case LogTag::MAPPING_MOD_AFTER:
+            return "mapping: add mod after";
+        case LogTag::PREFIX_TAP_DOWN:
+            return "not used prefix key down";
+        case LogTag::PREFIX_TAP_UP:
+            return "not used prefix key up";
+        case LogTag::RELEASE_DOWN_KEY:
+            return "release down key";
+        case LogTag::MOD_BEFORE:
+            return "add mod before";
+        case LogTag::MAPPED_KEY:
+            return "mapped key";
+        case LogTag::MOD_AFTER:
+            return "add mod after";
+        case LogTag::WRITTEN_NOW_DOWN:
+            return "written now down";
+        case LogTag::WRITTEN_NOW_UP:
+            return "written now up";
+        case LogTag::NOT_MAPPED_IN_LAYER:
+            return "in layer, but not mapped";
+        case LogTag::DEFAULT:
+            return "default case";
+        case LogTag::ACTIVATE_LAYER:
+            return "activate_layer";
+        case LogTag::DEACTIVATE_LAYER:
+            return "deactivate_layer";
+        case LogTag::TOGGLE_LAYER:
+            return "toggle_layer";
+        case LogTag::RESOLVED:
+            return "resolved";
+        case LogTag::TAP_HOLD_PENDING:
+            return "held back while the prefix is undecided";
+        case LogTag::TAP_HOLD_TAP:
+            return "prefix decided as tap";
+        case LogTag::TAP_HOLD_HOLD:
+            return "prefix decided as hold";
+        case LogTag::COMBO_PENDING:
+            return "held back while the combo is undecided";
+        case LogTag::COMBO_MOD_BEFORE:
+            return "combo_mod_before";
+        case LogTag::COMBO_KEY:
+            return "combo_key";
+        case LogTag::COMBO_MOD_AFTER:
+            return "combo_mod_after";
+        case LogTag::COMBO_CONSUMED:
+            return "swallowed key of a combo";
+        case LogTag::REPEAT:
+            return "repeat of the held key";
+        case LogTag::REPEAT_DROPPED:
+            return "dropped repeat";
+    }
+    return "unknown";
+}
+
+void StreamLog::operator()(LogTag tag, int code, int value) const {
+    *out << describe(tag) << " code: " << code << " value: " << value << std::endl;
+}
+
+uint64_t schoenberg::monotonic_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void write_record(std::ostream &out, const TraceRecord &record) {
+    out << record.time << " " << describe(record.tag) << " " << serialize_key(record.code)
+        << " value: " << record.value << "\n";
+}
+
+TraceDrain::TraceDrain(TraceRing &ring, const std::string &file) : ring(ring) {
+    thread = std::thread([this, file]() {
+        std::ofstream out(file, std::ios::out | std::ios::app);
+        TraceRecord record;
+        uint64_t reported = 0;
+        while (true) {
+            auto stopping = !running.load();
+            while (this->ring.pop(record)) {
+                write_record(out, record);
+            }
+            auto dropped = this->ring.dropped.load(std::memory_order_relaxed);
+            if (dropped != reported) {
+                out << "dropped " << dropped - reported << " records\n";
+                reported = dropped;
+            }
+            out.flush();
+            if (stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+}
+
+TraceDrain::~TraceDrain() {
+    running = false;
+    thread.join();
+}
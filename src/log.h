@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <linux/input.h>
+
+namespace schoenberg {
+
+    /**
+     * what the engine did, logged as a tag instead of a formatted message.
+     */
+    enum class LogTag : uint8_t {
+        INPUT,
+        MAPPING_MOD_BEFORE,
+        MAPPING_KEY,
+        MAPPING_MOD_AFTER,
+        PREFIX_TAP_DOWN,
+        PREFIX_TAP_UP,
+        RELEASE_DOWN_KEY,
+        MOD_BEFORE,
+        MAPPED_KEY,
+        MOD_AFTER,
+        WRITTEN_NOW_DOWN,
+        WRITTEN_NOW_UP,
+        NOT_MAPPED_IN_LAYER,
+        DEFAULT,
+        ACTIVATE_LAYER,
+        DEACTIVATE_LAYER,
+        TOGGLE_LAYER,
+        RESOLVED,
+        TAP_HOLD_PENDING,
+        TAP_HOLD_TAP,
+        TAP_HOLD_HOLD,
+        COMBO_PENDING,
+        COMBO_MOD_BEFORE,
+        COMBO_KEY,
+        COMBO_MOD_AFTER,
+        COMBO_CONSUMED,
+        REPEAT,
+        REPEAT_DROPPED,
+    };
+
+    const char *describe(LogTag tag);
+
+    /**
+     * the logger of the production build, every call compiles to nothing.
+     */
+    struct NoLog {
+        static constexpr bool enabled = false;
+
+        void operator()(LogTag, int, int) const {}
+    };
+
+    /**
+     * formats every record into a stream, for tests and debugging.
+     */
+    struct StreamLog {
+        static constexpr bool enabled = true;
+
+        std::ostream *out;
+
+        void operator()(LogTag tag, int code, int value) const;
+    };
+
+    struct TraceRecord {
+        uint64_t time;
+        int32_t value;
+        uint16_t code;
+        LogTag tag;
+    };
+
+    /**
+     * single producer, single consumer ring of trace records.
+     * the event loop pushes without ever blocking, a full ring drops the record and counts it.
+     */
+    class TraceRing {
+    public:
+        static constexpr size_t CAPACITY = 4096;
+
+        bool push(const TraceRecord &record) {
+            auto t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            records[t % CAPACITY] = record;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(TraceRecord &record) {
+            auto h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            record = records[h % CAPACITY];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::atomic<uint64_t> dropped{0};
+
+    private:
+        TraceRecord records[CAPACITY];
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+    };
+
+    uint64_t monotonic_ns();
+
+    /**
+     * writes binary records into a TraceRing, the formatting happens in the TraceDrain.
+     */
+    struct TraceLog {
+        static constexpr bool enabled = true;
+
+        TraceRing *ring;
+
+        void operator()(LogTag tag, int code, int value) const {
+            ring->push(TraceRecord{monotonic_ns(), value, (uint16_t) code, tag});
+        }
+    };
+
+    /**
+     * background thread that empties a TraceRing into a file.
+     */
+    class TraceDrain {
+    public:
+        TraceDrain(TraceRing &ring, const std::string &file);
+
+        ~TraceDrain();
+
+        TraceDrain(const TraceDrain &) = delete;
+
+        TraceDrain &operator=(const TraceDrain &) = delete;
+
+    private:
+        TraceRing &ring;
+        std::atomic<bool> running{true};
+        std::thread thread;
+    };
+
+};
@@ -1,5 +1,26 @@
-#include "utils.h"
 #include "schoenberg.h"
+#include "io.h"
+#include "pipeline.h"
+#include "cache.h"
+#ifdef SCHOENBERG_DAEMON
+#include "daemon.h"
+#endif
+#include "log.h"
+#include "profile.h"
+#include "realtime.h"
+#include "record.h"
+#include "reload.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "timer.h"
+#ifdef SCHOENBERG_KEYMAP
+#include SCHOENBERG_KEYMAP
+#endif
+#include <cerrno>
+#include <poll.h>
+#include <memory>
+#include <getopt.h>
+#include <iostream>
 #include <unistd.h>
 #include <linux/input.h>
 
@@ -7,46 +28,358 @@ using namespace std;
 using namespace schoenberg;
 
 
+#ifdef SCHOENBERG_KEYMAP
+// the keymap is compiled in (see schoenberg_gen), there is no config file to read, compile or watch
+constexpr int CONFIG_ARGUMENTS = 0;
+#else
+constexpr int CONFIG_ARGUMENTS = 1;
+#endif
+
+Config keymap(char *argv[]) {
+#ifdef SCHOENBERG_KEYMAP
+    return generated::config();
+#else
+    return schoenberg::load_config(argv[optind]);
+#endif
+}
+
+// the config given as the argument is the profile named default, the ones from --profile follow it
+void load_profiles(Profiles &profiles, const Config &config, const vector<pair<string, string>> &files) {
+    profiles.add("default", config);
+    for (const auto &[name, file]: files) {
+        profiles.add(name, schoenberg::load_config(file));
+    }
+}
+
+void usage(const char *name) {
+#ifdef SCHOENBERG_KEYMAP
+    cerr << "usage: " << name << " [--trace FILE]" << endl;
+    cerr << "       " << name << " --daemon DEVICE..." << endl;
+    cerr << "  the keymap " << generated::SOURCE << " is compiled in" << endl;
+#else
+    cerr << "usage: " << name << " [--trace FILE] [--no-watch] CONFIG" << endl;
+    cerr << "       " << name << " --compile CONFIG" << endl;
+    cerr << "       " << name << " --daemon CONFIG DEVICE..." << endl;
+    cerr << "  --compile     write the compiled config next to CONFIG for a faster start and exit" << endl;
+    cerr << "  --no-watch    only reload the config on SIGHUP, not when the file changes" << endl;
+#endif
+    cerr << "  --daemon      grab the evdev DEVICEs directly and write to uinput, instead of stdin/stdout" << endl;
+    cerr << "  --profile NAME=CONFIG" << endl;
+    cerr << "                load CONFIG as the profile NAME next to the one named default, any number of times."
+         << endl;
+    cerr << "                the profiles are not reloaded" << endl;
+    cerr << "  --control SOCKET" << endl;
+    cerr << "                switch the profile on requests to the unix socket SOCKET, see schoenberg_ctl" << endl;
+    cerr << "  --trace FILE  append a trace of every processed event to FILE" << endl;
+    cerr << "  --realtime[=PRIORITY]" << endl;
+    cerr << "                run the event loop with SCHED_FIFO (priority 50 by default) and locked, prefaulted memory"
+         << endl;
+    cerr << "  --cpu N       with --realtime, pin the event loop to cpu N" << endl;
+    cerr << "  --record FILE append every input and output event to the binary trace FILE, see schoenberg_replay"
+         << endl;
+    cerr << "  --stats NAME  keep a latency histogram in the shared memory segment NAME, see schoenberg_stats" << endl;
+    cerr << "  --state NAME  keep the held keys and layers in the shared memory segment NAME and adopt them on start,"
+         << endl;
+    cerr << "                so a restart with the same config does not leave keys or layers stuck" << endl;
+}
+
+// the event loop, instantiated once per logger so the production build has no logging code in it
+template<typename Log>
+int run(std::unique_ptr<Engine> engine, ConfigReloader *reloader, ProfileEngines *profiles, StateSegment *snapshot,
+        LatencyHistogram *latency, Recorder *recorder, Log log) {
+    // drain everything that is ready, process it and write the result with one writev.
+    // the flush happens as soon as the input runs dry, so complete frames are never held back.
+    EventReader reader(STDIN_FILENO);
+    EventWriter writer(STDOUT_FILENO);
+    // the kernel timestamps evdev events with the wall clock unless the reader asks for another
+    writer.measure(latency, CLOCK_REALTIME);
+    reader.record(recorder);
+    writer.record(recorder);
+    OutputBuffer<> output;
+    // the deadlines of the engine are on the clock of the event timestamps
+    DeadlineTimer timer(CLOCK_REALTIME);
+    pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {timer.fd, POLLIN, 0}};
+    // with profiles they own the engines, otherwise engine does
+    auto current = profiles ? profiles->current() : engine.get();
+    // an adopted state may wait for a deadline already
+    timer.arm(next_deadline(current->state));
+
+    while (true) {
+        auto expired = false;
+        // without a tapping term or combos the engine never waits for time, a blocking read is all it takes
+        if (current->state.timed()) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return 1;
+            }
+            expired = fds[1].revents & POLLIN && timer.fired();
+        } else {
+            fds[0].revents = POLLIN;
+        }
+
+        if (fds[0].revents) {
+            if (!reader.fill()) {
+                return writer.flush() ? 0 : 1;
+            }
+            // a reloaded config or another profile only takes over when nothing is held
+            if (reloader && reloader->ready() && current->idle()) {
+                engine.reset(reloader->swap(engine.release()));
+                current = engine.get();
+            }
+            if (profiles) {
+                current = profiles->select();
+            }
+            if (current->state.timed()) {
+                // for events without a timestamp
+                current->state.now = timer.now();
+            }
+            forward_ready(*current, reader, output, writer, log);
+        }
+        // after the input, which may be older than the deadline and decide differently
+        if (expired) {
+            forward_expired(*current, timer.now(), output, writer, log);
+        }
+        timer.arm(next_deadline(current->state));
+        if (!writer.flush()) {
+            return 1;
+        }
+        // after the flush, the saved state never has keys down the output has not seen
+        if (snapshot) {
+            snapshot->save(*current);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        cerr << argv[1] << std::endl;
-        cerr << "exactly one argument (not " << argc - 1 << "), which is the path to the config file, has to provided";
+    static option options[] = {
+            {"trace",    required_argument, nullptr, 't'},
+            {"no-watch", no_argument,       nullptr, 'w'},
+            {"compile",  no_argument,       nullptr, 'c'},
+            {"daemon",   no_argument,       nullptr, 'd'},
+            {"realtime", optional_argument, nullptr, 'r'},
+            {"cpu",      required_argument, nullptr, 'p'},
+            {"stats",    required_argument, nullptr, 's'},
+            {"record",   required_argument, nullptr, 'o'},
+            {"profile",  required_argument, nullptr, 'f'},
+            {"control",  required_argument, nullptr, 'k'},
+            {"state",    required_argument, nullptr, 'x'},
+            {"help",     no_argument,       nullptr, 'h'},
+            {nullptr, 0,                    nullptr, 0},
+    };
+    string trace_file;
+    string stats_name;
+    string record_file;
+    vector<pair<string, string>> profile_files;
+    string control_socket;
+    string state_name;
+    bool watch = true;
+    bool compile = false;
+    bool daemon = false;
+    bool realtime = false;
+    RealtimeOptions realtime_options;
+    realtime_options.priority = 50;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 't':
+                trace_file = optarg;
+                break;
+            case 'w':
+                watch = false;
+                break;
+            case 'c':
+                compile = true;
+                break;
+            case 'd':
+                daemon = true;
+                break;
+            case 'r':
+                realtime = true;
+                if (optarg) {
+                    realtime_options.priority = atoi(optarg);
+                }
+                break;
+            case 'p':
+                realtime_options.cpu = atoi(optarg);
+                break;
+            case 's':
+                stats_name = optarg;
+                break;
+            case 'o':
+                record_file = optarg;
+                break;
+            case 'f': {
+                string profile = optarg;
+                auto equals = profile.find('=');
+                if (equals == string::npos || equals == 0) {
+                    cerr << "--profile takes NAME=CONFIG, not " << profile << endl;
+                    return 1;
+                }
+                profile_files.emplace_back(profile.substr(0, equals), profile.substr(equals + 1));
+                break;
+            }
+            case 'k':
+                control_socket = optarg;
+                break;
+            case 'x':
+                state_name = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (daemon) {
+#ifdef SCHOENBERG_DAEMON
+        if (!record_file.empty()) {
+            // the devices are interleaved, a trace could not be replayed
+            cerr << "--record works on the stdin/stdout pipeline only, not with --daemon" << endl;
+            return 1;
+        }
+        if (!state_name.empty()) {
+            // the daemon grabs the devices itself, it is not restarted under a running pipeline
+            cerr << "--state works on the stdin/stdout pipeline only, not with --daemon" << endl;
+            return 1;
+        }
+        if (argc - optind < CONFIG_ARGUMENTS + 1) {
+            cerr << "the daemon needs the config and at least one device" << endl;
+            usage(argv[0]);
+            return 1;
+        }
+        Profiles profiles;
+        load_profiles(profiles, keymap(argv), profile_files);
+        Daemon schoenberg_daemon(profiles, cerr);
+        // after the daemon blocked its signals, so the control thread does not take them
+        std::unique_ptr<ProfileControl> control;
+        if (!control_socket.empty()) {
+            control = std::make_unique<ProfileControl>(profiles, control_socket, cerr);
+        }
+        std::unique_ptr<StatsSegment> stats;
+        if (!stats_name.empty()) {
+            stats = std::make_unique<StatsSegment>(StatsSegment::create(stats_name, CLOCK_MONOTONIC));
+            schoenberg_daemon.measure(stats->histogram);
+        }
+        auto grabbed = 0;
+        for (auto i = optind + CONFIG_ARGUMENTS; i < argc; i++) {
+            try {
+                schoenberg_daemon.add_device(argv[i]);
+                grabbed++;
+            } catch (const std::exception &e) {
+                cerr << e.what() << endl;
+            }
+        }
+        if (!grabbed) {
+            return 1;
+        }
+        if (realtime) {
+            enter_realtime(realtime_options, cerr);
+            schoenberg_daemon.prefault();
+        }
+        return schoenberg_daemon.run();
+#else
+        cerr << "this build has no --daemon, it needs libevdev" << endl;
+        return 1;
+#endif
+    }
+    if (argc - optind != CONFIG_ARGUMENTS) {
+#ifdef SCHOENBERG_KEYMAP
+        cerr << "the keymap is compiled in, this build takes no config file" << endl;
+#else
+        cerr << "exactly one argument (not " << argc - optind << "), which is the path to the config file, has to provided"
+             << endl;
+#endif
+        usage(argv[0]);
         return 1;
     }
-    struct input_event event;
-    setbuf(stdin, NULL), setbuf(stdout, NULL);
-    auto config = schoenberg::read_config(argv[1]);
-    auto state = schoenberg::build_state(config);
-
-    NulOStream log_file;
-    NulOStream log_written;
-    NulOStream logs;
 
-    /*
-    std::ofstream log_file("/tmp/key_logs.txt", std::ios::out | std::ios::app | std::ios::ate);
-    std::ofstream log_written("/tmp/key_written.txt", std::ios::out | std::ios::app | std::ios::ate);
-    std::ofstream logs("/tmp/key_logs.txt", std::ios::out | std::ios::app | std::ios::ate);
-     */
+    std::unique_ptr<ConfigReloader> reloader;
+#ifndef SCHOENBERG_KEYMAP
+    string config_file = argv[optind];
+    if (compile) {
+        schoenberg::write_cache(config_file);
+        return 0;
+    }
+#endif
+    std::unique_ptr<Engine> engine;
+    Profiles profiles;
+    std::unique_ptr<ProfileEngines> profile_engines;
+    std::unique_ptr<ProfileControl> control;
+    if (profile_files.empty() && control_socket.empty()) {
+        engine = std::make_unique<Engine>(keymap(argv));
+#ifndef SCHOENBERG_KEYMAP
+        // before any thread is started, so only the reload thread sees SIGHUP
+        ConfigReloader::block_reload_signal();
+        reloader = std::make_unique<ConfigReloader>(config_file, watch, cerr);
+#endif
+    } else {
+        // every profile is built now, switching between them parses and builds nothing
+        load_profiles(profiles, keymap(argv), profile_files);
+        profile_engines = std::make_unique<ProfileEngines>(profiles);
+        if (!control_socket.empty()) {
+            control = std::make_unique<ProfileControl>(profiles, control_socket, cerr);
+        }
+    }
 
-    while (fread(&event, sizeof(event), 1, stdin) == 1) {
-        if (event.type == EV_MSC && event.code == MSC_SCAN) {
-            continue;
+    // the state a previous run left, for the engine (or profile) built from the same config
+    std::unique_ptr<StateSegment> snapshot;
+    if (!state_name.empty()) {
+        snapshot = std::make_unique<StateSegment>(StateSegment::open(state_name));
+        auto adopted = false;
+        if (profile_engines) {
+            const auto &engines = profile_engines->all();
+            for (size_t i = 0; i < engines.size() && !adopted; i++) {
+                if ((adopted = snapshot->restore(*engines[i]))) {
+                    profiles.select(i);
+                    profile_engines->select();
+                }
+            }
+        } else {
+            adopted = snapshot->restore(*engine);
         }
-        if (event.type != EV_KEY) {
-            fwrite(&event, sizeof(event), 1, stdout);
-            continue;
+        if (adopted) {
+            cerr << "adopted the state in " << state_name << endl;
         }
+    }
 
-        log_file << "code: " << schoenberg::serialize_key(event.code) << " value: " << event.value << std::endl;
-        auto mapped_keys = schoenberg::process_mapping(config, event, logs);
+    std::unique_ptr<StatsSegment> stats;
+    if (!stats_name.empty()) {
+        stats = std::make_unique<StatsSegment>(StatsSegment::create(stats_name, CLOCK_REALTIME));
+    }
+    auto latency = stats ? stats->histogram : nullptr;
+
+    std::unique_ptr<Recorder> recorder;
+    if (!record_file.empty()) {
+        recorder = std::make_unique<Recorder>(record_file);
+    }
 
-        for (auto me: mapped_keys) {
-            auto res = schoenberg::process_for_layer(state, me, logs);
-            for (auto e:res) {
-                log_written << "code: " << schoenberg::serialize_key(e.code) << " value: " << e.value << std::endl;
-                fwrite(&e, sizeof(e), 1, stdout);
+    // the records are formatted and written by a background thread, off the event path
+    TraceRing ring;
+    std::unique_ptr<TraceDrain> drain;
+    if (!trace_file.empty()) {
+        drain = std::make_unique<TraceDrain>(ring, trace_file);
+    }
+
+    // after the background threads are started, they keep the normal scheduler
+    if (realtime) {
+        enter_realtime(realtime_options, cerr);
+        if (profile_engines) {
+            for (const auto &profile: profile_engines->all()) {
+                prefault(*profile);
             }
+        } else {
+            prefault(*engine);
         }
     }
 
+    if (drain) {
+        return run(std::move(engine), reloader.get(), profile_engines.get(), snapshot.get(), latency, recorder.get(),
+                   TraceLog{&ring});
+    }
+    return run(std::move(engine), reloader.get(), profile_engines.get(), snapshot.get(), latency, recorder.get(),
+               NoLog());
 }
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "schoenberg.h"
+#include "io.h"
+
+namespace schoenberg {
+
+    constexpr input_event SYN_EVENT = {.type = EV_SYN, .code = SYN_REPORT, .value = 0};
+
+    // queues output whose events have their timestamps already, a SYN_REPORT gets the one of the event before it
+    inline size_t write_frames(const OutputSpan &output, EventWriter &writer) {
+        auto written = output.size();
+        output.for_each_frame([&](const input_event *events, size_t count) {
+            if (count == 0) {
+                return;
+            }
+            if (events != output.begin()) {
+                auto syn = SYN_EVENT;
+                syn.time = events[-1].time;
+                writer.push(syn);
+                written++;
+            }
+            writer.push(reinterpret_cast<const char *>(events), count * sizeof(input_event));
+        });
+        return written;
+    }
+
+    /**
+     * queues the output of the engine, with a SYN_REPORT between the frames the engine ended. the open last
+     * frame is left to the caller. every event gets the timestamp of its source. returns the queued events.
+     */
+    inline size_t write_frames(OutputSpan &output, const timeval &time, EventWriter &writer) {
+        for (size_t i = 0; i < output.size(); i++) {
+            output.events[i].time = time;
+        }
+        return write_frames(output, writer);
+    }
+
+    /**
+     * the path every input event takes: scan codes are dropped, everything but keys is passed through
+     * and keys go through the engine. the result is queued on the writer, returns the number of queued events.
+     */
+    template<typename Log>
+    size_t forward(Engine &engine, const input_event &event, OutputSpan &output, EventWriter &writer, Log log) {
+        if (event.type == EV_MSC && event.code == MSC_SCAN) {
+            return 0;
+        }
+        if (event.type != EV_KEY) {
+            writer.push(event);
+            return 1;
+        }
+
+        output.clear();
+        process(engine.config, engine.state, event, output, log);
+        return write_frames(output, event.time, writer);
+    }
+
+    /**
+     * lets the engine act on a deadline that passed (a tapping term), its output ends with its own SYN_REPORT.
+     */
+    template<typename Log>
+    void forward_expired(Engine &engine, uint64_t now, OutputSpan &output, EventWriter &writer, Log log) {
+        output.clear();
+        expire(engine.config, engine.state, now, output, log);
+        if (output.empty()) {
+            return;
+        }
+        timeval time{time_t(now / 1000000000), suseconds_t(now % 1000000000 / 1000)};
+        write_frames(output, time, writer);
+        auto syn = SYN_EVENT;
+        syn.time = time;
+        writer.push(syn);
+    }
+
+    /**
+     * forwards whole frames at once with process_batch, the same as forward would one by one.
+     * returns the number of queued events.
+     */
+    template<typename Log>
+    size_t forward_batch(Engine &engine, const input_event *events, size_t count, OutputSpan &output,
+                         EventWriter &writer, Log log) {
+        BatchFrame frame;
+        size_t written = 0;
+        while (count > 0) {
+            output.clear();
+            auto taken = process_batch(engine.config, engine.state, events, count, output, frame, log);
+            written += write_frames(output, writer);
+            events += taken;
+            count -= taken;
+        }
+        return written;
+    }
+
+    /**
+     * forwards the next complete frame the reader holds, false if there is none. a frame without key events
+     * (mouse motion, touchpad, SYN only) is copied to the writer as a whole, a frame with keys goes event by event
+     * through forward. a frame that ends up empty is not written at all.
+     */
+    template<typename Log>
+    bool forward_frame(Engine &engine, EventReader &reader, OutputSpan &output, EventWriter &writer, Log log) {
+        bool keys;
+        auto events = reader.frame(keys);
+        if (!events) {
+            return false;
+        }
+        if (!keys) {
+            reader.pass(events, writer);
+            return true;
+        }
+        // the SYN_REPORT of a frame the engine swallowed completely (a prefix press) is dropped as well
+        input_event event;
+        size_t written = 0;
+        for (size_t i = 0; i < events && reader.pop(event); i++) {
+            if (i + 1 < events || written) {
+                written += forward(engine, event, output, writer, log);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * forwards everything the reader holds, frame by frame with forward_frame. (forward_batch measured slower
+     * than this in release builds, the engine dominates and classifying the batch does not pay off)
+     */
+    template<typename Log>
+    void forward_ready(Engine &engine, EventReader &reader, OutputSpan &output, EventWriter &writer, Log log) {
+        while (forward_frame(engine, reader, output, writer, log)) {
+        }
+        // the start of a frame whose SYN_REPORT is not there yet
+        input_event event;
+        while (reader.pop(event)) {
+            forward(engine, event, output, writer, log);
+        }
+    }
+
+    /**
+     * the timer of the event loop on a clock that is not the real one: every deadline of the engine before now
+     * expires at its own time, like forward_expired when the timer fires.
+     */
+    template<typename Log>
+    void forward_expired_until(Engine &engine, uint64_t now, OutputSpan &output, EventWriter &writer, Log log) {
+        for (auto deadline = next_deadline(engine.state); deadline && deadline < now;
+             deadline = next_deadline(engine.state)) {
+            forward_expired(engine, deadline, output, writer, log);
+        }
+    }
+
+    /**
+     * forward_ready for recorded input (schoenberg_replay): the clock is the one of the event timestamps.
+     * the deadlines that passed before a frame expire first, where the timer of schoenberg_run fired between
+     * two reads.
+     */
+    template<typename Log>
+    void forward_recorded(Engine &engine, EventReader &reader, OutputSpan &output, EventWriter &writer, Log log) {
+        input_event next;
+        while (reader.peek(next)) {
+            auto now = uint64_t(next.time.tv_sec) * 1000000000 + uint64_t(next.time.tv_usec) * 1000;
+            forward_expired_until(engine, now, output, writer, log);
+            if (!forward_frame(engine, reader, output, writer, log)) {
+                break;
+            }
+        }
+        while (reader.pop(next)) {
+            forward(engine, next, output, writer, log);
+        }
+    }
+
+};
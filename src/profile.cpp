@@ -0,0 +1,168 @@
+#include "profile.h"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+void Profiles::add(const std::string &name, const Config &config) {
+    if (find(name) >= 0) {
+        throw std::runtime_error("profile " + name + " is defined twice");
+    }
+    names.push_back(name);
+    configs.push_back(config);
+}
+
+int Profiles::find(const std::string &name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+ProfileEngines::ProfileEngines(const Profiles &profiles) : profiles(profiles) {
+    for (size_t i = 0; i < profiles.size(); i++) {
+        engines.push_back(std::make_unique<Engine>(profiles.config(i)));
+    }
+    active = profiles.requested();
+}
+
+namespace {
+
+    sockaddr_un socket_address(const std::string &path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("socket path " + path + " is too long");
+        }
+        strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+}
+
+ProfileControl::ProfileControl(Profiles &profiles, const std::string &path, std::ostream &errors) :
+        profiles(profiles), path(path), errors(errors) {
+    auto address = socket_address(path);
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw std::runtime_error(string("can not create a socket: ") + strerror(errno));
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 4) < 0) {
+        auto error = errno;
+        close(listener);
+        throw std::runtime_error("can not listen on " + path + ": " + strerror(error));
+    }
+    stop = eventfd(0, EFD_CLOEXEC);
+    thread = std::thread([this]() { run(); });
+}
+
+ProfileControl::~ProfileControl() {
+    uint64_t one = 1;
+    if (write(stop, &one, sizeof(one)) < 0) {
+        errors << "can not stop the control thread" << endl;
+    }
+    thread.join();
+    close(stop);
+    close(listener);
+    unlink(path.c_str());
+}
+
+std::string ProfileControl::handle(const std::string &request) {
+    if (request == "list") {
+        string res;
+        for (size_t i = 0; i < profiles.size(); i++) {
+            res += (i == profiles.requested() ? "* " : "  ") + profiles.name(i) + "\n";
+        }
+        return res;
+    }
+    if (request.rfind("use ", 0) == 0) {
+        auto name = request.substr(4);
+        auto profile = profiles.find(name);
+        if (profile < 0) {
+            return "error unknown profile " + name + "\n";
+        }
+        profiles.select(profile);
+        errors << "switching to profile " << name << endl;
+        return "ok " + name + "\n";
+    }
+    return "error unknown request " + request + "\n";
+}
+
+void ProfileControl::serve(int client) {
+    // a client that does not send its line in time is dropped, the thread has others to serve
+    timeval timeout{1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    string request;
+    char buffer[256];
+    while (request.find('\n') == string::npos && request.size() < 1024) {
+        auto length = read(client, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        request.append(buffer, length);
+    }
+    request = request.substr(0, request.find('\n'));
+    auto reply = handle(request);
+    if (send(client, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) {
+        errors << "can not answer on " << path << ": " << strerror(errno) << endl;
+    }
+}
+
+void ProfileControl::run() {
+    pollfd fds[] = {{stop,     POLLIN, 0},
+                    {listener, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errors << "control thread: " << strerror(errno) << endl;
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            auto client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                serve(client);
+                close(client);
+            }
+        }
+    }
+}
+
+std::string schoenberg::control_request(const std::string &path, const std::string &request) {
+    auto address = socket_address(path);
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        auto error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("can not connect to " + path + ": " + strerror(error));
+    }
+    auto line = request + "\n";
+    string reply;
+    if (send(fd, line.data(), line.size(), MSG_NOSIGNAL) == ssize_t(line.size())) {
+        // the control thread closes the connection after its reply
+        char buffer[256];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            reply.append(buffer, length);
+        }
+    }
+    close(fd);
+    if (reply.empty()) {
+        throw std::runtime_error("no reply from " + path);
+    }
+    return reply;
+}
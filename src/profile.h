@@ -0,0 +1,129 @@
+#pragma once
+
+#include "schoenberg.h"
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace schoenberg {
+
+    /**
+     * named configs, all loaded when the process starts. the first one is active until another is requested
+     * (see ProfileControl). a request only publishes the index of the profile, the event loops pick it up
+     * themselves with ProfileEngines::select.
+     */
+    class Profiles {
+    public:
+        Profiles() = default;
+
+        Profiles(const Profiles &) = delete;
+
+        Profiles &operator=(const Profiles &) = delete;
+
+        void add(const std::string &name, const Config &config);
+
+        size_t size() const {
+            return configs.size();
+        }
+
+        const std::string &name(size_t profile) const {
+            return names[profile];
+        }
+
+        const Config &config(size_t profile) const {
+            return configs[profile];
+        }
+
+        // the index of the profile, -1 if there is none with that name
+        int find(const std::string &name) const;
+
+        size_t requested() const {
+            return request.load(std::memory_order_relaxed);
+        }
+
+        void select(size_t profile) {
+            request.store(profile, std::memory_order_relaxed);
+        }
+
+    private:
+        std::vector<std::string> names;
+        std::vector<Config> configs;
+        std::atomic<size_t> request{0};
+    };
+
+    /**
+     * an engine per profile for one event loop (the pipeline or one device of the daemon), built up front.
+     * switching is a compare of the requested index and, once nothing is held, a pointer swap: nothing is parsed
+     * or built on the event path and an engine keeps its state while another profile is active.
+     */
+    class ProfileEngines {
+    public:
+        explicit ProfileEngines(const Profiles &profiles);
+
+        Engine *current() const {
+            return engines[active].get();
+        }
+
+        size_t current_profile() const {
+            return active;
+        }
+
+        // the engine to process the next events with, the requested one if the current one is idle
+        Engine *select() {
+            auto requested = profiles.requested();
+            if (requested != active && engines[active]->idle()) {
+                active = requested;
+            }
+            return engines[active].get();
+        }
+
+        const std::vector<std::unique_ptr<Engine>> &all() const {
+            return engines;
+        }
+
+    private:
+        const Profiles &profiles;
+        std::vector<std::unique_ptr<Engine>> engines;
+        size_t active = 0;
+    };
+
+    /**
+     * selects the profile on requests over a unix socket, in a background thread.
+     * a request is one line, the reply is one or more lines:
+     *   use NAME   switch to the profile NAME, "ok NAME" or "error ..."
+     *   list       the profiles, the requested one marked with *
+     */
+    class ProfileControl {
+    public:
+        // throws if the socket can not be created, an existing file at path is replaced
+        ProfileControl(Profiles &profiles, const std::string &path, std::ostream &errors);
+
+        ~ProfileControl();
+
+        ProfileControl(const ProfileControl &) = delete;
+
+        ProfileControl &operator=(const ProfileControl &) = delete;
+
+        // the reply to one request line
+        std::string handle(const std::string &request);
+
+    private:
+        void run();
+
+        void serve(int client);
+
+        Profiles &profiles;
+        std::string path;
+        std::ostream &errors;
+        int listener = -1;
+        int stop = -1;
+        std::thread thread;
+    };
+
+    // sends a request to the ProfileControl at path and returns the reply, throws if it can not be reached
+    std::string control_request(const std::string &path, const std::string &request);
+
+};
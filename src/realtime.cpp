@@ -0,0 +1,94 @@
+#include "realtime.h"
+#include <algorithm>
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace schoenberg;
+
+// about what the event loop needs, with room for the logger and libc
+constexpr size_t STACK_PREFAULT = 256 * 1024;
+
+void schoenberg::prefault(const void *memory, size_t length) {
+    static const auto page = size_t(sysconf(_SC_PAGESIZE));
+    auto bytes = static_cast<const volatile char *>(memory);
+    for (size_t offset = 0; offset < length; offset += page) {
+        (void) bytes[offset];
+    }
+    if (length > 0) {
+        (void) bytes[length - 1];
+    }
+}
+
+__attribute__((noinline)) void schoenberg::prefault_stack(size_t length) {
+    auto stack = static_cast<volatile char *>(alloca(length));
+    static const auto page = size_t(sysconf(_SC_PAGESIZE));
+    for (size_t offset = 0; offset < length; offset += page) {
+        stack[offset] = 0;
+    }
+}
+
+void schoenberg::prefault(const Engine &engine) {
+    prefault(&engine, sizeof(engine));
+    for (const auto &layer: engine.config.layers) {
+        prefault(&layer, sizeof(layer));
+    }
+    for (const auto &layer: engine.state.layers) {
+        prefault(&layer, sizeof(layer));
+    }
+    if (!engine.state.resolved.empty()) {
+        prefault(engine.state.resolved.data(), engine.state.resolved.size() * sizeof(ResolutionTable));
+    }
+}
+
+RealtimeStatus schoenberg::enter_realtime(const RealtimeOptions &options, std::ostream &report) {
+    RealtimeStatus status;
+
+    if (options.priority > 0) {
+        auto min = sched_get_priority_min(SCHED_FIFO);
+        auto max = sched_get_priority_max(SCHED_FIFO);
+        sched_param param{};
+        param.sched_priority = std::min(std::max(options.priority, min), max);
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+            status.scheduled = true;
+            report << "realtime: SCHED_FIFO priority " << param.sched_priority << endl;
+        } else {
+            report << "realtime: SCHED_FIFO not available (" << strerror(errno)
+                   << "), keeping the normal scheduler" << endl;
+        }
+    }
+
+    if (options.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        auto error = EINVAL;
+        if (options.cpu < CPU_SETSIZE) {
+            CPU_SET(options.cpu, &cpus);
+            error = sched_setaffinity(0, sizeof(cpus), &cpus) == 0 ? 0 : errno;
+        }
+        if (error == 0) {
+            status.pinned = true;
+            report << "realtime: pinned to cpu " << options.cpu << endl;
+        } else {
+            report << "realtime: can not pin to cpu " << options.cpu << " (" << strerror(error)
+                   << "), running on any cpu" << endl;
+        }
+    }
+
+    if (options.lock) {
+        // future allocations too, so a reloaded engine is locked as well
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+            status.locked = true;
+            report << "realtime: memory locked" << endl;
+        } else {
+            report << "realtime: can not lock memory (" << strerror(errno) << "), only prefaulting" << endl;
+        }
+    }
+
+    // locked or not, the stack of the event loop is mapped now and not on the first keystroke
+    prefault_stack(STACK_PREFAULT);
+    return status;
+}
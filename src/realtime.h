@@ -0,0 +1,45 @@
+#pragma once
+
+#include "schoenberg.h"
+#include <cstddef>
+#include <ostream>
+
+namespace schoenberg {
+
+    class RealtimeOptions {
+    public:
+        // SCHED_FIFO priority, 0 keeps the normal scheduler
+        int priority = 0;
+        // the cpu the event loop is pinned to, -1 for no pinning
+        int cpu = -1;
+        // lock all current and future memory with mlockall
+        bool lock = true;
+    };
+
+    // what actually took effect, everything that failed has been reported
+    class RealtimeStatus {
+    public:
+        bool scheduled = false;
+        bool pinned = false;
+        bool locked = false;
+    };
+
+    /**
+     * moves the calling thread (the event loop) into a low latency setup: SCHED_FIFO, pinned to a cpu and with
+     * all memory locked and the stack prefaulted, so a keystroke never waits for the scheduler or a page fault.
+     * the engine tables are prefaulted by the caller, see prefault(const Engine &).
+     * scheduling and pinning only apply to the calling thread, background threads like the config reload keep
+     * running normally. missing privileges are not an error, every setting reports whether it took effect.
+     */
+    RealtimeStatus enter_realtime(const RealtimeOptions &options, std::ostream &report);
+
+    // touches every page, so the first access on the event path does not fault
+    void prefault(const void *memory, size_t length);
+
+    // grows the stack by the given size once, so later calls run on mapped pages
+    void prefault_stack(size_t length);
+
+    // the tables the event loop reads: the config, the layers and the precomputed resolutions
+    void prefault(const Engine &engine);
+
+};
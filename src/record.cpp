@@ -0,0 +1,132 @@
+#include "record.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace schoenberg;
+
+namespace {
+
+    constexpr char MAGIC[8] = {'S', 'C', 'H', 'T', 'R', 'C', 'E', '\0'};
+    constexpr uint32_t VERSION = 1;
+
+    size_t file_size(size_t records) {
+        return sizeof(TraceHeader) + records * sizeof(RecordedEvent);
+    }
+
+    bool valid(const TraceHeader &header) {
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+               header.record_size == sizeof(RecordedEvent);
+    }
+
+    std::runtime_error error(const std::string &what, const std::string &file) {
+        return std::runtime_error(what + " " + file + ": " + strerror(errno));
+    }
+
+}
+
+Recorder::Recorder(const std::string &file) : file(file) {
+    fd = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw error("can not open the trace", file);
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        throw error("can not read the trace", file);
+    }
+
+    TraceHeader existing{};
+    auto fresh = info.st_size == 0;
+    if (!fresh && (pread(fd, &existing, sizeof(existing), 0) != sizeof(existing) || !valid(existing) ||
+                   size_t(info.st_size) < file_size(existing.count))) {
+        close(fd);
+        throw std::runtime_error("not a trace, not appending to it: " + file);
+    }
+    try {
+        map(existing.count + CHUNK);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    if (fresh) {
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->version = VERSION;
+        header->record_size = sizeof(RecordedEvent);
+        header->count = 0;
+    }
+}
+
+Recorder::~Recorder() {
+    auto count = header->count;
+    munmap(header, file_size(capacity));
+    // drop the preallocated, unused rest. if that fails, the count in the header still marks the end
+    auto res = ftruncate(fd, file_size(count));
+    (void) res;
+    close(fd);
+}
+
+void Recorder::map(size_t records_capacity) {
+    auto length = file_size(records_capacity);
+    auto res = posix_fallocate(fd, 0, length);
+    if (res != 0) {
+        errno = res;
+        throw error("can not allocate space for the trace", file);
+    }
+    void *memory;
+    if (header) {
+        memory = mremap(header, file_size(capacity), length, MREMAP_MAYMOVE);
+    } else {
+        memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (memory == MAP_FAILED) {
+        throw error("can not map the trace", file);
+    }
+    header = static_cast<TraceHeader *>(memory);
+    records = reinterpret_cast<RecordedEvent *>(static_cast<char *>(memory) + sizeof(TraceHeader));
+    capacity = records_capacity;
+}
+
+void Recorder::grow() {
+    map(capacity + CHUNK);
+}
+
+Trace::Trace(const std::string &file) {
+    auto fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw error("can not open the trace", file);
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || size_t(info.st_size) < sizeof(TraceHeader)) {
+        close(fd);
+        throw std::runtime_error("not a trace: " + file);
+    }
+    length = info.st_size;
+    memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    auto mapped = memory != MAP_FAILED;
+    auto saved = errno;
+    close(fd);
+    if (!mapped) {
+        memory = nullptr;
+        errno = saved;
+        throw error("can not map the trace", file);
+    }
+    auto header = static_cast<const TraceHeader *>(memory);
+    if (!valid(*header) || length < file_size(header->count)) {
+        munmap(memory, length);
+        memory = nullptr;
+        throw std::runtime_error("not a trace: " + file);
+    }
+    count = header->count;
+    records = reinterpret_cast<const RecordedEvent *>(static_cast<const char *>(memory) + sizeof(TraceHeader));
+}
+
+Trace::~Trace() {
+    if (memory) {
+        munmap(memory, length);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <linux/input.h>
+
+namespace schoenberg {
+
+    /**
+     * binary trace of a session: the header followed by every input and output event in the order they passed,
+     * as they are in memory. written by schoenberg_run --record, read by schoenberg_replay.
+     */
+    struct TraceHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        // records in the file, the preallocated rest of the file is not part of the trace
+        uint64_t count;
+        uint64_t reserved;
+    };
+
+    struct RecordedEvent {
+        static constexpr uint32_t INPUT = 0;
+        static constexpr uint32_t OUTPUT = 1;
+
+        uint32_t direction;
+        uint32_t reserved;
+        input_event event;
+    };
+
+    /**
+     * appends to a trace through a shared mapping of the file. the file grows in preallocated chunks,
+     * so recording an event is a copy into memory and the kernel writes it back in the background.
+     * the count in the header is always up to date, a trace survives a crash of the recorder.
+     */
+    class Recorder {
+    public:
+        static constexpr size_t CHUNK = 64 * 1024;
+
+        // opens or creates the trace and continues after its last record, throws on failure
+        explicit Recorder(const std::string &file);
+
+        ~Recorder();
+
+        Recorder(const Recorder &) = delete;
+
+        Recorder &operator=(const Recorder &) = delete;
+
+        void input(const input_event &event) { append(RecordedEvent::INPUT, event); }
+
+        void output(const input_event &event) { append(RecordedEvent::OUTPUT, event); }
+
+        size_t size() const { return header->count; }
+
+    private:
+        void append(uint32_t direction, const input_event &event) {
+            if (header->count == capacity) {
+                grow();
+            }
+            records[header->count] = RecordedEvent{direction, 0, event};
+            header->count++;
+        }
+
+        void grow();
+
+        void map(size_t records);
+
+        std::string file;
+        int fd = -1;
+        TraceHeader *header = nullptr;
+        RecordedEvent *records = nullptr;
+        size_t capacity = 0;
+    };
+
+    /**
+     * a trace mapped read only.
+     */
+    class Trace {
+    public:
+        // throws if the file is not a trace
+        explicit Trace(const std::string &file);
+
+        ~Trace();
+
+        Trace(const Trace &) = delete;
+
+        Trace &operator=(const Trace &) = delete;
+
+        size_t size() const { return count; }
+
+        const RecordedEvent *begin() const { return records; }
+
+        const RecordedEvent *end() const { return records + count; }
+
+    private:
+        void *memory = nullptr;
+        size_t length = 0;
+        const RecordedEvent *records = nullptr;
+        size_t count = 0;
+    };
+
+};
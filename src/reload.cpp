@@ -0,0 +1,134 @@
+#include "reload.h"
+#include "cache.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+void ConfigReloader::block_reload_signal() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+}
+
+string directory_of(const string &file) {
+    auto slash = file.rfind('/');
+    return slash == string::npos ? "." : (slash == 0 ? "/" : file.substr(0, slash));
+}
+
+string name_of(const string &file) {
+    auto slash = file.rfind('/');
+    return slash == string::npos ? file : file.substr(slash + 1);
+}
+
+ConfigReloader::ConfigReloader(const std::string &file, bool watch, std::ostream &errors) : file(file),
+                                                                                             errors(errors) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    signals = signalfd(-1, &mask, SFD_CLOEXEC);
+    stop = eventfd(0, EFD_CLOEXEC);
+    if (watch) {
+        // editors replace the file instead of writing it, so the directory is watched
+        inotify = inotify_init1(IN_CLOEXEC);
+        if (inotify >= 0 && inotify_add_watch(inotify, directory_of(file).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            errors << "can not watch " << file << ": " << strerror(errno) << endl;
+            close(inotify);
+            inotify = -1;
+        }
+    }
+    thread = std::thread([this]() { run(); });
+}
+
+ConfigReloader::~ConfigReloader() {
+    stop_requested = true;
+    uint64_t one = 1;
+    if (write(stop, &one, sizeof(one)) < 0) {
+        errors << "can not stop the reload thread" << endl;
+    }
+    thread.join();
+    delete pending.exchange(nullptr);
+    delete retired.exchange(nullptr);
+    for (auto fd: {inotify, signals, stop}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+Engine *ConfigReloader::swap(Engine *current) {
+    // only the reload thread clears retired, so it stays free once it is. nothing is freed on the event path
+    if (retired.load(std::memory_order_acquire)) {
+        return current;
+    }
+    auto next = pending.exchange(nullptr, std::memory_order_acquire);
+    if (!next) {
+        return current;
+    }
+    // the layers the user toggled on stay on, while the old engine is still ours
+    if (current) {
+        next->adopt_toggles(*current);
+    }
+    retired.store(current, std::memory_order_release);
+    uint64_t one = 1;
+    if (write(stop, &one, sizeof(one)) < 0) {
+        errors << "can not wake the reload thread" << endl;
+    }
+    return next;
+}
+
+void ConfigReloader::reload() {
+    try {
+        auto engine = new Engine(load_config(file));
+        delete pending.exchange(engine, std::memory_order_release);
+        errors << "reloaded " << file << endl;
+    } catch (const std::exception &e) {
+        errors << "can not reload " << file << ", keeping the old config: " << e.what() << endl;
+    }
+}
+
+void ConfigReloader::run() {
+    auto name = name_of(file);
+    pollfd fds[] = {{stop,     POLLIN, 0},
+                    {signals,  POLLIN, 0},
+                    {inotify,  POLLIN, 0}};
+    while (!stop_requested) {
+        if (poll(fds, inotify >= 0 ? 3 : 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errors << "reload thread: " << strerror(errno) << endl;
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(stop, &count, sizeof(count)) > 0) {
+                delete retired.exchange(nullptr, std::memory_order_acq_rel);
+            }
+        }
+        auto changed = false;
+        if (fds[1].revents & POLLIN) {
+            signalfd_siginfo info;
+            changed |= read(signals, &info, sizeof(info)) == sizeof(info);
+        }
+        if (inotify >= 0 && fds[2].revents & POLLIN) {
+            alignas(inotify_event) char buffer[4096];
+            auto length = read(inotify, buffer, sizeof(buffer));
+            for (auto p = buffer; length > 0 && p < buffer + length;) {
+                auto event = reinterpret_cast<inotify_event *>(p);
+                changed |= event->len && name == event->name;
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (changed) {
+            reload();
+        }
+    }
+}
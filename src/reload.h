@@ -0,0 +1,56 @@
+#pragma once
+
+#include "schoenberg.h"
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace schoenberg {
+
+    /**
+     * reloads the config in a background thread, on SIGHUP and (with watch) whenever the file changes.
+     * the new Engine is parsed and built off the event path and published through an atomic pointer,
+     * the event loop picks it up with swap() at a point where the old engine is idle.
+     *
+     * SIGHUP has to be blocked (block_reload_signal) before any thread is started.
+     */
+    class ConfigReloader {
+    public:
+        ConfigReloader(const std::string &file, bool watch, std::ostream &errors);
+
+        ~ConfigReloader();
+
+        ConfigReloader(const ConfigReloader &) = delete;
+
+        ConfigReloader &operator=(const ConfigReloader &) = delete;
+
+        // a cheap check for the event loop. a new engine waits until the reload thread freed the one retired before
+        bool ready() const {
+            return pending.load(std::memory_order_relaxed) != nullptr &&
+                   retired.load(std::memory_order_relaxed) == nullptr;
+        }
+
+        // returns the new engine if one is ready (otherwise current), the old one is freed by the reload thread.
+        // the new engine takes over the toggled layers of current
+        Engine *swap(Engine *current);
+
+        static void block_reload_signal();
+
+    private:
+        void run();
+
+        void reload();
+
+        std::string file;
+        std::ostream &errors;
+        std::atomic<Engine *> pending{nullptr};
+        std::atomic<Engine *> retired{nullptr};
+        std::atomic<bool> stop_requested{false};
+        int inotify = -1;
+        int signals = -1;
+        int stop = -1;
+        std::thread thread;
+    };
+
+};
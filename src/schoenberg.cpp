@@ -2,53 +2,56 @@
 #include <yaml-cpp/yaml.h>
 #include <iostream>
 #include "map"
-#include <libevdev/libevdev.h>
+#include "log.h"
+#include "keycodes.h"
+#ifdef SCHOENBERG_KEYMAP
+#include SCHOENBERG_KEYMAP
+#endif
 
 using namespace schoenberg;
 
-vector<int> down_keys(State &state) {
-    vector<int> res;
-    for (auto e: state.key_state) {
-        if (e.second > 0) {
-            res.push_back(e.first);
-        }
-    }
-    return res;
+bool has_down_key(State &state) {
+    return state.key_state.any();
 }
 
-bool has_down_key(State &state) {
-    return !down_keys(state).empty();
+int schoenberg::parse_key(std::string_view keyCode) {
+    return keycodes::find(keyCode);
 }
 
-int schoenberg::parse_key(string keyCode) {
-    std::stringstream key;
-    key << "KEY_" << keyCode;
-    auto res = libevdev_event_code_from_name(EV_KEY, key.str().c_str());
-    return res;
+std::string_view schoenberg::key_name(int code) {
+    return keycodes::name(code);
 }
 
 string schoenberg::serialize_key(int code) {
-    auto res = libevdev_event_code_get_name(EV_KEY, code);
-    if (res != NULL) {
-        auto resStr = string(res);
-        return resStr.substr(4);
+    auto name = keycodes::name(code);
+    if (name.empty()) {
+        return "UNKNOWN(" + std::to_string(code) + ")";
     }
-    return NULL;
+    return string(name);
+}
+
+// like parse_key, but unknown names are an error in the config
+int parse_config_key(const string &keyCode) {
+    auto res = parse_key(keyCode);
+    if (!valid_key(res)) {
+        throw std::invalid_argument("unknown key in config: " + keyCode);
+    }
+    return res;
 }
 
 KeyTarget parse_key_target(YAML::Node node) {
     if (node.IsScalar()) {
         auto keyInfo = node.as<string>();
-        return KeyTarget(parse_key(keyInfo), -1);
+        return KeyTarget(parse_config_key(keyInfo), -1);
     } else {
         auto keyInfo = node["key"].as<string>();
 
         auto modKey = -1;
         if (node["mod"]) {
             auto modInfo = node["mod"].as<string>();
-            modKey = parse_key(modInfo);
+            modKey = parse_config_key(modInfo);
         }
-        return KeyTarget(parse_key(keyInfo), modKey);
+        return KeyTarget(parse_config_key(keyInfo), modKey);
     }
 }
 
@@ -58,166 +61,754 @@ Config schoenberg::read_config(const string &file) {
     YAML::Node mapping = config["mapping"];
     vector<LayerConfig> outputLayers;
 
-    map<int, KeyTarget> keys;
+    KeyTable keys;
 
     for (auto layer:layers) {
         YAML::Node keys = layer["keys"];
-        map<int, KeyTarget> keys_output;
+        KeyTable keys_output;
 
         for (YAML::const_iterator it = keys.begin(); it != keys.end(); ++it) {
-            keys_output[parse_key(it->first.as<string>())] = parse_key_target(it->second);
+            keys_output[parse_config_key(it->first.as<string>())] = parse_key_target(it->second);
         }
+        auto prefix = layer["prefix"].as<std::string>();
+        parse_config_key(prefix);
         outputLayers.emplace_back(
-                layer["prefix"].as<std::string>(),
+                prefix,
                 keys_output
         );
+        if (layer["toggle"]) {
+            outputLayers.back().toggle = layer["toggle"].as<bool>();
+        }
     }
     for (YAML::const_iterator it = mapping.begin(); it != mapping.end(); ++it) {
-        keys[parse_key(it->first.as<string>())] = parse_key_target(it->second);
+        keys[parse_config_key(it->first.as<string>())] = parse_key_target(it->second);
     }
-    return Config(outputLayers, keys);
+    Config res(outputLayers, keys);
+    if (config["tapping_term"]) {
+        res.tapping_term = config["tapping_term"].as<uint32_t>();
+    }
+    if (config["permissive_hold"]) {
+        res.permissive_hold = config["permissive_hold"].as<bool>();
+    }
+    for (auto combo: config["combos"]) {
+        vector<int> combo_keys;
+        for (auto key: combo["keys"]) {
+            combo_keys.push_back(parse_config_key(key.as<string>()));
+        }
+        res.combos.emplace_back(combo_keys, parse_key_target(combo));
+    }
+    if (config["combo_term"]) {
+        res.combo_term = config["combo_term"].as<uint32_t>();
+    }
+    if (config["repeat_rate"]) {
+        res.repeat_rate = config["repeat_rate"].as<uint32_t>();
+    }
+    if (config["repeat_delay"]) {
+        res.repeat_delay = config["repeat_delay"].as<uint32_t>();
+    }
+    res.machine = compile_combos(res.combos);
+    return res;
 }
 
-State schoenberg::build_state(const Config &config) {
-    std::map<int, LayerState> output_layers;
-    for (const auto &layer: config.layers) {
-        auto key = parse_key(layer.prefix);
-        auto state = LayerState(false, false, false, layer.keys);
-        output_layers.insert({key, state});
+ComboMachine schoenberg::compile_combos(const vector<ComboConfig> &combos) {
+    ComboMachine machine;
+    vector<vector<int>> sets;
+    for (const auto &combo: combos) {
+        auto keys = combo.keys;
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        if (keys.size() < 2 || keys.size() > ComboMachine::MAX_KEYS) {
+            throw std::invalid_argument("a combo needs 2 to " + std::to_string(ComboMachine::MAX_KEYS) + " keys");
+        }
+        if (std::find(sets.begin(), sets.end(), keys) != sets.end()) {
+            throw std::invalid_argument("duplicate combo");
+        }
+        for (auto key: keys) {
+            if (machine.column[key] < 0) {
+                machine.column[key] = machine.columns++;
+            }
+        }
+        sets.push_back(keys);
+    }
+    if (machine.empty()) {
+        return machine;
     }
-    return State(map<int, int>(), output_layers);
-}
 
-std::optional<pair<int, LayerState>> find_active_layer(State &state) {
-    std::optional<pair<int, LayerState>> activeLayer;
-    for (auto entry: state.layers) {
-        if (entry.second.active) {
-            activeLayer = entry;
-            break;
+    // the nodes are the key sets that are part of a combo, numbered as they are found from the empty set
+    std::map<vector<int>, int> nodes{{{}, 0}};
+    vector<vector<int>> queue{{}};
+    for (size_t node = 0; node < queue.size(); node++) {
+        auto keys = queue[node];
+        machine.next.resize(machine.next.size() + machine.columns, 0);
+        machine.targets.emplace_back();
+        machine.extends.push_back(0);
+        for (size_t i = 0; i < sets.size(); i++) {
+            if (std::includes(sets[i].begin(), sets[i].end(), keys.begin(), keys.end())) {
+                if (sets[i].size() == keys.size()) {
+                    machine.targets[node] = combos[i].target;
+                } else {
+                    machine.extends[node] = 1;
+                }
+            }
+        }
+        for (int code = 0; code < KEY_CNT; code++) {
+            if (machine.column[code] < 0 || std::binary_search(keys.begin(), keys.end(), code)) {
+                continue;
+            }
+            auto with = keys;
+            with.insert(std::upper_bound(with.begin(), with.end(), code), code);
+            auto part_of_combo = false;
+            for (const auto &set: sets) {
+                part_of_combo |= std::includes(set.begin(), set.end(), with.begin(), with.end());
+            }
+            if (!part_of_combo) {
+                continue;
+            }
+            auto found = nodes.find(with);
+            if (found == nodes.end()) {
+                if (queue.size() > UINT16_MAX) {
+                    throw std::length_error("too many combos");
+                }
+                found = nodes.emplace(with, queue.size()).first;
+                queue.push_back(with);
+            }
+            machine.next[node * machine.columns + machine.column[code]] = found->second;
         }
     }
-    return activeLayer;
+    return machine;
 }
 
+void resolve(const Config &config, State &state);
+
+State schoenberg::build_state(const Config &config) {
+    LayerTable output_layers;
+    for (const auto &layer: config.layers) {
+        auto key = parse_key(layer.prefix);
+        LayerState layer_state(key, false, false, false, layer.keys);
+        layer_state.toggle = layer.toggle;
+        output_layers.add(layer_state);
+    }
+    State state(output_layers);
+    state.tapping_term = uint64_t(config.tapping_term) * 1000000;
+    state.permissive_hold = config.permissive_hold;
+    if (!config.machine.empty()) {
+        state.combo_term = uint64_t(config.combo_term) * 1000000;
+    }
+    if (config.repeat_rate > 0) {
+        state.repeat_interval = 1000000000 / config.repeat_rate;
+        state.repeat_delay = uint64_t(config.repeat_delay) * 1000000;
+    }
+    resolve(config, state);
+    return state;
+}
 
 input_event create_event(__u16 code, int value) {
     return input_event{.type = EV_KEY, .code = code, .value = value};
 }
 
-vector<input_event> create_release_events(vector<int> keys) {
-    vector<input_event> res;
-    for (auto k: keys) {
-        res.push_back(create_event(k, 0));
-    }
-    return res;
+template<typename Log>
+void add_event(OutputSpan &events, input_event event, LogTag tag, Log &log) {
+    log(tag, event.code, event.value);
+    events.push(event);
+}
 
+template<typename Log>
+void release_down_keys(State &state, OutputSpan &events, Log &log) {
+    state.key_state.for_each([&](int code) {
+        add_event(events, create_event(code, 0), LogTag::RELEASE_DOWN_KEY, log);
+    });
 }
 
-void add_event(vector<input_event> &events, input_event event, string message, std::ostream &logs) {
-    logs << "add event " << event.code << " value: " << event.value << " message: " << message << endl;
-    events.push_back(event);
+template<typename Log>
+void activate_layer(State &state, int code, Log &log) {
+    log(LogTag::ACTIVATE_LAYER, code, 1);
+    // stacking a layer on a held one is a use of the held one
+    if (auto below = state.active()) {
+        below->used = true;
+    }
+    state.active_layer = state.layers.position(code);
+    auto &layer = state.layers.by_position(state.active_layer);
+    layer.active = true;
+    layer.held = true;
+    layer.used = false;
+    layer.written = false;
+    state.stack |= uint64_t(1) << state.active_layer;
+    if (state.tapping_term > 0) {
+        state.pending.code = code;
+        state.pending.deadline = state.now + state.tapping_term;
+        state.pending.count = 0;
+    }
 }
 
-void activate_layer(State &state, int code, std::ostream &logs) {
-    logs << "activate_layer " << code << endl;
-    state.layers[code].active = true;
-    state.layers[code].used = false;
-    state.layers[code].written = false;
+/**
+ * the prefix of a held layer is released. if the layer was not used that was a tap: a toggle layer
+ * is switched, any other writes its prefix key.
+ */
+template<typename Log>
+void release_layer(State &state, int position, OutputSpan &out, Log &log) {
+    auto &layer = state.layers.by_position(position);
+    auto tap = !layer.used && !layer.written;
+    layer.held = false;
+    if (tap && layer.toggle) {
+        layer.toggled = !layer.toggled;
+        log(LogTag::TOGGLE_LAYER, layer.code, layer.toggled);
+    }
+    layer.active = layer.toggled;
+    if (!layer.active) {
+        log(LogTag::DEACTIVATE_LAYER, layer.code, 0);
+        state.stack &= ~(uint64_t(1) << position);
+    }
+    if (state.active_layer == position) {
+        state.active_layer = -1;
+        for (int i = (int) state.layers.size() - 1; i >= 0; i--) {
+            if (state.layers.by_position(i).held) {
+                state.active_layer = i;
+                break;
+            }
+        }
+    }
+    if (tap && !layer.toggle) {
+        add_event(out, create_event(layer.code, 1), LogTag::PREFIX_TAP_DOWN, log);
+        out.end_frame();
+        add_event(out, create_event(layer.code, 0), LogTag::PREFIX_TAP_UP, log);
+    }
 }
 
-void deactivate_layer(State &state, int code, std::ostream &logs) {
-    logs << "deactivate_layer " << code << endl;
-    state.layers[code].active = false;
+// the target of the highest layer on the stack that maps the code, unmapped if none does
+KeyTarget lookup_stack(const LayerTable &layers, uint64_t stack, int code) {
+    while (stack) {
+        auto top = 63 - __builtin_clzll(stack);
+        auto target = layers.by_position(top).keys.lookup(code);
+        if (target.mapped()) {
+            return target;
+        }
+        stack &= ~(uint64_t(1) << top);
+    }
+    return KeyTarget();
 }
 
-void update_key_state(State &state, vector<input_event> events) {
-    for (auto e: events) {
-        state.key_state[e.code] = e.value;
+void update_key_state(State &state, const OutputSpan &events, size_t from) {
+    for (auto i = from; i < events.size(); i++) {
+        state.key_state.set(events[i].code, events[i].value);
     }
 }
 
-vector<input_event> schoenberg::process_for_layer(State &state, input_event event, std::ostream &logs) {
-    vector<input_event> res;
+template<typename Log>
+size_t process_for_layer_impl(State &state, input_event event, OutputSpan &res, Log &log) {
+    auto start = res.size();
 
-    auto activeLayer = find_active_layer(state);
+    auto position = state.layers.position(event.code);
+    auto prefix = position >= 0 ? &state.layers.by_position(position) : nullptr;
 
     // handle special cases
-    if (activeLayer.has_value() && event.value == 0 && activeLayer.value().first == event.code) {
-        deactivate_layer(state, event.code, logs);
-        if (!activeLayer.value().second.used && !activeLayer.value().second.written) {
-            add_event(res, create_event(event.code, 1), "not used prefix key down", logs);
-            add_event(res, create_event(event.code, 0), "not used prefix key up", logs);
-        }
+    if (prefix && prefix->held && event.value == 0) {
+        release_layer(state, position, res, log);
 
         // if there are still keys that are not release, release them now
-        auto downs = down_keys(state);
-        auto down_release = create_release_events(downs);
-        for (auto release: down_release) {
-            add_event(res, release, "release down key", logs);
-        }
-
-        update_key_state(state, res);
-        return res;
-    } else if (!has_down_key(state) && !activeLayer.has_value() && event.value == 1 && state.layers.count(event.code)) {
-        activate_layer(state, event.code, logs);
-        update_key_state(state, res);
-        return res;
-    } else if (event.value == 2 && state.layers.count(event.code)) {
-        state.layers[event.code].used = true;
+        release_down_keys(state, res, log);
+
+        update_key_state(state, res, start);
+        return res.size() - start;
+    } else if (prefix && !prefix->held && event.value == 1 && !has_down_key(state) &&
+               !lookup_stack(state.layers, state.stack, event.code).mapped()) {
+        // a prefix the layers below do not map stacks its layer on them
+        activate_layer(state, event.code, log);
+        return 0;
+    } else if (prefix && event.value == 2) {
+        prefix->used = true;
         // ignore holding a layer key
-        update_key_state(state, res);
-        return res;
+        return 0;
     }
 
-    activeLayer = find_active_layer(state);
-
-    if (activeLayer.has_value()) {
+    if (state.stack) {
+        auto activeLayer = state.active();
         // check if key is mapped
-        if (activeLayer.value().second.keys.count(event.code)) {
-            auto target = activeLayer.value().second.keys[event.code];
+        auto target = lookup_stack(state.layers, state.stack, event.code);
+        if (target.mapped()) {
             if (target.mod > 0 && event.value == 1) {
-                add_event(res, create_event(target.mod, 1), "add mod before", logs);
+                add_event(res, create_event(target.mod, 1), LogTag::MOD_BEFORE, log);
+                res.end_frame();
             }
-            add_event(res, create_event(target.key, event.value), "mapped key", logs);
+            add_event(res, create_event(target.key, event.value), LogTag::MAPPED_KEY, log);
             if (target.mod > 0 && event.value == 0) {
-                add_event(res, create_event(target.mod, 0), "add mod after", logs);
+                res.end_frame();
+                add_event(res, create_event(target.mod, 0), LogTag::MOD_AFTER, log);
             }
         } else {
             // if an layer is active but key is not mapped still write it throw
-            if (!state.layers[activeLayer.value().first].used && event.value == 1) {
-                add_event(res, create_event(activeLayer.value().first, 1), "written now down", logs);
-                add_event(res, create_event(activeLayer.value().first, 0), "written now up", logs);
-                state.layers[activeLayer.value().first].written = true;
+            if (activeLayer && !activeLayer->used && !activeLayer->toggle && event.value == 1) {
+                add_event(res, create_event(activeLayer->code, 1), LogTag::WRITTEN_NOW_DOWN, log);
+                res.end_frame();
+                add_event(res, create_event(activeLayer->code, 0), LogTag::WRITTEN_NOW_UP, log);
+                activeLayer->written = true;
             }
-            add_event(res, create_event(event.code, event.value), "in layer, but not mapped", logs);
+            add_event(res, create_event(event.code, event.value), LogTag::NOT_MAPPED_IN_LAYER, log);
         }
         // if there is an active value with an down or hold event mark it as used
-        if (event.value == 1) {
-            state.layers[activeLayer.value().first].used = true;
+        if (activeLayer && event.value == 1) {
+            activeLayer->used = true;
         }
     } else {
-        add_event(res, event, "default case", logs);
+        add_event(res, event, LogTag::DEFAULT, log);
     }
-    update_key_state(state, res);
-    return res;
+    update_key_state(state, res, start);
+    return res.size() - start;
 }
 
-vector<input_event> schoenberg::process_mapping(Config &config, input_event event, std::ostream &logs) {
-    auto res = vector<input_event>();
-    if (config.keys.count(event.code)) {
-        auto target = config.keys[event.code];
+template<typename Log>
+size_t process_mapping_impl(const Config &config, input_event event, OutputSpan &res, Log &log) {
+    auto start = res.size();
+    auto target = config.keys.lookup(event.code);
+    if (target.mapped()) {
         if (target.mod > 0 && event.value == 1) {
-            add_event(res, create_event(target.mod, 1), "mapping: add mod before", logs);
+            add_event(res, create_event(target.mod, 1), LogTag::MAPPING_MOD_BEFORE, log);
+            res.end_frame();
         }
-        add_event(res, create_event(target.key, event.value), "mapping: mapped key", logs);
+        add_event(res, create_event(target.key, event.value), LogTag::MAPPING_KEY, log);
         if (target.mod > 0 && event.value == 0) {
-            add_event(res, create_event(target.mod, 0), "mapping: add mod after", logs);
+            res.end_frame();
+            add_event(res, create_event(target.mod, 0), LogTag::MAPPING_MOD_AFTER, log);
         }
     } else {
-        res.push_back(event);
+        res.push(event);
+    }
+    return res.size() - start;
+}
+
+// the layer pass over the output of the mapping, the frame ends of the mapping are kept
+template<typename Log>
+size_t process_mapped(State &state, const OutputSpan &mapped, OutputSpan &out, Log &log) {
+    auto start = out.size();
+    for (size_t i = 0; i < mapped.size(); i++) {
+        process_for_layer_impl(state, mapped[i], out, log);
+        if (mapped.frame_end(i)) {
+            out.end_frame();
+        }
+    }
+    return out.size() - start;
+}
+
+/**
+ * the resolution of every key code with the layers of the stack active. every entry is computed by running
+ * the event through the general path on a scratch state with those layers, so both paths agree by construction.
+ * the scratch state is built once per stack and reset between the entries.
+ */
+void resolve_stack(const Config &config, const State &state, uint64_t stack, ResolutionTable &table) {
+    NoLog log;
+    State scratch(state.layers);
+    OutputBuffer<> out;
+    OutputBuffer<3> mapped;
+    auto reset = [&]() {
+        scratch.key_state.clear();
+        scratch.active_layer = -1;
+        scratch.stack = stack;
+        for (int i = 0; i < (int) scratch.layers.size(); i++) {
+            auto &layer = scratch.layers.by_position(i);
+            layer.active = stack >> i & 1;
+            layer.held = false;
+            layer.toggled = false;
+            // used, so the prefix tap is left to the runtime
+            layer.used = true;
+            layer.written = false;
+        }
+        out.clear();
+    };
+
+    for (int code = 0; code < KEY_CNT; code++) {
+        auto &resolution = table[code];
+
+        mapped.clear();
+        process_mapping_impl(config, create_event(code, 1), mapped, log);
+        auto involves_prefix = false;
+        for (const auto &e: mapped) {
+            involves_prefix |= state.layers.count(e.code);
+        }
+        if (involves_prefix) {
+            resolution.flags = Resolution::GENERAL;
+            continue;
+        }
+        resolution.flags = 0;
+
+        for (int value = 0; value <= 2; value++) {
+            reset();
+            mapped.clear();
+            process_mapping_impl(config, create_event(code, value), mapped, log);
+            process_mapped(scratch, mapped, out, log);
+            if (out.size() > 4) {
+                resolution.flags = Resolution::GENERAL;
+                break;
+            }
+            resolution.count[value] = out.size();
+            resolution.ends[value] = 0;
+            for (size_t i = 0; i < out.size(); i++) {
+                resolution.steps[value][i] = {out[i].code, (__s16) out[i].value};
+                resolution.ends[value] |= out.frame_end(i) << i;
+            }
+        }
+        // the first event the mapping produces for a press decides whether an unused prefix is written
+        mapped.clear();
+        process_mapping_impl(config, create_event(code, 1), mapped, log);
+        if (stack && !lookup_stack(state.layers, stack, mapped[0].code).mapped()) {
+            resolution.flags |= Resolution::TAP_PREFIX;
+        }
+    }
+}
+
+/**
+ * fills state.resolved with the empty stack, every layer on its own and, while there are at most
+ * MAX_RESOLVED_STACKS of them, every pair of layers (a held layer on a toggled one). all of it here, when the
+ * config is built: the event path never resolves a stack, larger stacks take the general path.
+ */
+void resolve(const Config &config, State &state) {
+    vector<uint64_t> stacks{0};
+    auto layers = state.layers.size();
+    for (size_t i = 0; i < layers; i++) {
+        stacks.push_back(uint64_t(1) << i);
+    }
+    if (stacks.size() + layers * (layers - 1) / 2 <= MAX_RESOLVED_STACKS) {
+        for (size_t i = 0; i < layers; i++) {
+            for (size_t j = i + 1; j < layers; j++) {
+                stacks.push_back(uint64_t(1) << i | uint64_t(1) << j);
+            }
+        }
+    }
+    state.resolved.assign(stacks.size(), ResolutionTable());
+    state.slots.clear();
+    for (size_t slot = 0; slot < stacks.size(); slot++) {
+        resolve_stack(config, state, stacks[slot], state.resolved[slot]);
+        state.slots[stacks[slot]] = slot;
+    }
+    state.slot = 0;
+    state.slot_stack = 0;
+}
+
+// points state.slot at the resolution of the current stack, -1 for a stack that was not resolved
+void select_slot(State &state) {
+    auto found = state.slots.find(state.stack);
+    state.slot = found != state.slots.end() ? found->second : -1;
+    state.slot_stack = state.stack;
+}
+
+template<typename Log>
+size_t process_pending(Config &config, State &state, input_event event, OutputSpan &out, Log &log);
+
+template<typename Log>
+size_t process_combo(Config &config, State &state, input_event event, OutputSpan &out, Log &log);
+
+template<typename Log>
+size_t process_key(Config &config, State &state, input_event event, OutputSpan &out, Log &log);
+
+template<typename Log>
+size_t resolve_key(Config &config, State &state, input_event event, OutputSpan &out, Log &log);
+
+template<typename Log, typename>
+size_t schoenberg::process(Config &config, State &state, input_event event, OutputSpan &out, Log log) {
+    log(LogTag::INPUT, event.code, event.value);
+
+    if (state.timed() && (event.time.tv_sec || event.time.tv_usec)) {
+        state.now = uint64_t(event.time.tv_sec) * 1000000000 + uint64_t(event.time.tv_usec) * 1000;
+    }
+    // the combos see the input first, what they let through can still be a layer prefix
+    if (state.combo_term > 0) {
+        return process_combo(config, state, event, out, log);
+    }
+    return process_key(config, state, event, out, log);
+}
+
+/**
+ * a repeat of the key pressed last takes no lookup: it repeats the key its press wrote, which stays the same
+ * when the layers change in between. once that key is released (its layer was left) the repeats are dropped,
+ * just as all of them are when the engine generates its own.
+ */
+template<typename Log>
+size_t process_repeat(State &state, input_event event, OutputSpan &out, Log &log) {
+    if (state.repeat_interval || !state.key_state.down(state.repeat.key)) {
+        log(LogTag::REPEAT_DROPPED, event.code, event.value);
+        return 0;
+    }
+    add_event(out, create_event(state.repeat.key, 2), LogTag::REPEAT, log);
+    return 1;
+}
+
+// a repeat of the held key generated by the engine, the next one is due an interval later
+template<typename Log>
+void generate_repeat(State &state, OutputSpan &out, Log &log) {
+    auto &repeat = state.repeat;
+    if (!state.key_state.down(repeat.key)) {
+        repeat.deadline = 0;
+        return;
+    }
+    add_event(out, create_event(repeat.key, 2), LogTag::REPEAT, log);
+    repeat.deadline += state.repeat_interval;
+    // a late timer skips repeats instead of writing a burst of them
+    if (repeat.deadline <= state.now) {
+        repeat.deadline = state.now + state.repeat_interval;
+    }
+}
+
+// an input event that is not part of a combo
+template<typename Log>
+size_t process_key(Config &config, State &state, input_event event, OutputSpan &out, Log &log) {
+    if (state.pending.active()) {
+        return process_pending(config, state, event, out, log);
+    }
+    if (event.value == 2 && event.code == state.repeat.code) {
+        return process_repeat(state, event, out, log);
+    }
+    auto start = out.size();
+    resolve_key(config, state, event, out, log);
+    track_repeat(state, event, out, start);
+    return out.size() - start;
+}
+
+// the event through the mapping and the stack
+template<typename Log>
+size_t resolve_key(Config &config, State &state, input_event event, OutputSpan &out, Log &log) {
+    // fast path: one lookup in the precomputed table of the active stack
+    if (valid_key(event.code) && event.value >= 0 && event.value <= 2) {
+        if (state.slot_stack != state.stack) {
+            select_slot(state);
+        }
+        if (state.slot >= 0) {
+#ifdef SCHOENBERG_KEYMAP
+            // the keymap compiled in: the empty stack and the single layers are read from constant tables.
+            // only for an engine built from that keymap, not for one of another config (a --profile)
+            auto start = out.size();
+            if (config.compiled && generated::apply(state, event, out, log)) {
+                return out.size() - start;
+            }
+#endif
+            const auto &resolution = state.resolved[state.slot][event.code];
+            if (!(resolution.flags & Resolution::GENERAL)) {
+                return apply_resolution(state, resolution, event, out, log);
+            }
+        }
+    }
+
+    // the mapping produces at most the mod, the key and the mod again
+    OutputBuffer<3> mapped;
+    process_mapping_impl(config, event, mapped, log);
+
+    return process_mapped(state, mapped, out, log);
+}
+
+/**
+ * ends the tapping term of the pending prefix. a tap leaves the layer like a release of an unused prefix,
+ * a hold keeps the layer (used, so its release writes nothing). then the held back events run as if
+ * they came now.
+ */
+template<typename Log>
+void decide(Config &config, State &state, bool hold, OutputSpan &out, Log &log) {
+    auto pending = state.pending;
+    state.pending.code = -1;
+    state.pending.count = 0;
+
+    if (hold) {
+        log(LogTag::TAP_HOLD_HOLD, pending.code, 1);
+        state.layers[pending.code].used = true;
+    } else {
+        log(LogTag::TAP_HOLD_TAP, pending.code, 0);
+        release_layer(state, state.layers.position(pending.code), out, log);
+    }
+    // every held back event gets a frame of its own, like it would have had without the tapping term
+    out.end_frame();
+    for (size_t i = 0; i < pending.count; i++) {
+        process_key(config, state, pending.events[i], out, log);
+        out.end_frame();
     }
-    return res;
 }
 
+// an event while a prefix is undecided: it decides, or it is held back
+template<typename Log>
+size_t process_pending(Config &config, State &state, input_event event, OutputSpan &out, Log &log) {
+    auto start = out.size();
+    auto &pending = state.pending;
+    if (state.now >= pending.deadline) {
+        decide(config, state, true, out, log);
+        process_key(config, state, event, out, log);
+        return out.size() - start;
+    }
 
+    OutputBuffer<3> mapped;
+    process_mapping_impl(config, event, mapped, log);
+    for (const auto &e: mapped) {
+        if (e.code == pending.code) {
+            // released within the tapping term: a tap. repeats of the prefix are no decision
+            if (e.value == 0) {
+                decide(config, state, false, out, log);
+            }
+            return out.size() - start;
+        }
+    }
 
+    auto permissive = state.permissive_hold && event.value == 0 && pending.pressed(event.code);
+    if (permissive || pending.count == PendingPrefix::CAPACITY) {
+        decide(config, state, true, out, log);
+        process_key(config, state, event, out, log);
+        return out.size() - start;
+    }
+    log(LogTag::TAP_HOLD_PENDING, event.code, event.value);
+    pending.events[pending.count++] = event;
+    return 0;
+}
+
+template<typename Log>
+void release_combo(State &state, OutputSpan &out, Log &log) {
+    auto &held = state.combo.held;
+    auto start = out.size();
+    add_event(out, create_event(held.key, 0), LogTag::COMBO_KEY, log);
+    if (held.mod > 0) {
+        out.end_frame();
+        add_event(out, create_event(held.mod, 0), LogTag::COMBO_MOD_AFTER, log);
+    }
+    held = KeyTarget();
+    update_key_state(state, out, start);
+}
+
+/**
+ * ends the combo term of the pressed combo keys. if they complete a combo its target is pressed and the keys
+ * are swallowed until they are released, otherwise they run through the engine as if they came now.
+ */
+template<typename Log>
+void settle(Config &config, State &state, OutputSpan &out, Log &log) {
+    auto &combo = state.combo;
+    auto target = config.machine.targets[combo.node];
+    auto count = combo.count;
+    combo.node = 0;
+    combo.count = 0;
+
+    if (!target.mapped()) {
+        for (size_t i = 0; i < count; i++) {
+            process_key(config, state, combo.events[i], out, log);
+        }
+        return;
+    }
+    if (combo.held.mapped()) {
+        release_combo(state, out, log);
+        out.end_frame();
+    }
+    for (size_t i = 0; i < count; i++) {
+        combo.consumed.set(combo.events[i].code);
+    }
+    combo.consumed_count += count;
+    combo.held = target;
+
+    auto start = out.size();
+    if (target.mod > 0) {
+        add_event(out, create_event(target.mod, 1), LogTag::COMBO_MOD_BEFORE, log);
+        out.end_frame();
+    }
+    add_event(out, create_event(target.key, 1), LogTag::COMBO_KEY, log);
+    update_key_state(state, out, start);
+    // the kernel repeats the combo key pressed last
+    hold_repeat(state, combo.events[count - 1].code, target.key);
+}
+
+// the combo stage in front of the rest of the engine, every event costs a table lookup here
+template<typename Log>
+size_t process_combo(Config &config, State &state, input_event event, OutputSpan &out, Log &log) {
+    auto start = out.size();
+    auto &combo = state.combo;
+    if (combo.active() && state.now >= combo.deadline) {
+        settle(config, state, out, log);
+    }
+
+    if (combo.holding(event.code)) {
+        // a key of a fired combo: the first release releases the target, repeats repeat it
+        if (event.value == 0) {
+            log(LogTag::COMBO_CONSUMED, event.code, event.value);
+            combo.consumed.reset(event.code);
+            combo.consumed_count--;
+            track_repeat(state, event, out, out.size());
+            if (combo.held.mapped()) {
+                release_combo(state, out, log);
+            }
+        } else if (event.value == 2 && event.code == state.repeat.code) {
+            process_repeat(state, event, out, log);
+        }
+        return out.size() - start;
+    }
+
+    auto column = config.machine.column_of(event.code);
+    if (!combo.active()) {
+        // combos start on the base layer only, while a layer is active its keys mean something else
+        if (column < 0 || event.value != 1 || state.stack) {
+            return process_key(config, state, event, out, log);
+        }
+        combo.deadline = state.now + state.combo_term;
+    }
+
+    if (column >= 0 && event.value == 1) {
+        auto node = config.machine.step(combo.node, column);
+        if (node > 0) {
+            log(LogTag::COMBO_PENDING, event.code, event.value);
+            combo.node = node;
+            combo.events[combo.count++] = event;
+            if (!config.machine.extends[node]) {
+                // nothing longer can follow, no need to wait
+                settle(config, state, out, log);
+            }
+            return out.size() - start;
+        }
+    } else if (event.value == 2 && combo.pressed(event.code)) {
+        return 0;
+    }
+    // anything else decides: the keys so far are a combo or they are not
+    settle(config, state, out, log);
+    process_combo(config, state, event, out, log);
+    return out.size() - start;
+}
+
+template<typename Log, typename>
+size_t schoenberg::expire(Config &config, State &state, uint64_t now, OutputSpan &out, Log log) {
+    state.now = now;
+    auto start = out.size();
+    if (state.combo.active() && now >= state.combo.deadline) {
+        settle(config, state, out, log);
+    }
+    if (state.pending.active() && now >= state.pending.deadline) {
+        decide(config, state, true, out, log);
+    }
+    if (state.repeat.deadline && now >= state.repeat.deadline) {
+        generate_repeat(state, out, log);
+    }
+    return out.size() - start;
+}
+
+template size_t schoenberg::expire(Config &, State &, uint64_t, OutputSpan &, NoLog);
+
+template size_t schoenberg::expire(Config &, State &, uint64_t, OutputSpan &, StreamLog);
+
+template size_t schoenberg::expire(Config &, State &, uint64_t, OutputSpan &, TraceLog);
+
+template size_t schoenberg::process(Config &, State &, input_event, OutputSpan &, NoLog);
+
+template size_t schoenberg::process(Config &, State &, input_event, OutputSpan &, StreamLog);
+
+template size_t schoenberg::process(Config &, State &, input_event, OutputSpan &, TraceLog);
+
+size_t schoenberg::process(Config &config, State &state, input_event event, OutputSpan &out, std::ostream &logs) {
+    return process(config, state, event, out, StreamLog{&logs});
+}
+
+size_t schoenberg::process_for_layer(State &state, input_event event, OutputSpan &out, std::ostream &logs) {
+    StreamLog log{&logs};
+    return process_for_layer_impl(state, event, out, log);
+}
+
+size_t schoenberg::process_mapping(Config &config, input_event event, OutputSpan &out, std::ostream &logs) {
+    StreamLog log{&logs};
+    return process_mapping_impl(config, event, out, log);
+}
+
+vector<input_event> schoenberg::process_for_layer(State &state, input_event event, std::ostream &logs) {
+    OutputBuffer<> res;
+    process_for_layer(state, event, res, logs);
+    return vector<input_event>(res.begin(), res.end());
+}
+
+vector<input_event> schoenberg::process_mapping(Config &config, input_event event, std::ostream &logs) {
+    OutputBuffer<3> res;
+    process_mapping(config, event, res, logs);
+    return vector<input_event>(res.begin(), res.end());
+}
@@ -1,25 +1,128 @@
+#pragma once
+
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
+#include <array>
+#include <bitset>
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <unordered_map>
 #include <memory>
 #include <stdexcept>
+#include <cstring>
 #include <linux/input.h>
+#include "log.h"
 
 
 using namespace std;
 
 namespace schoenberg {
 
+    inline bool valid_key(int code) {
+        return code >= 0 && code < KEY_CNT;
+    }
+
     class KeyTarget {
     public:
-        int key;
-        int mod;
+        __s16 key = -1;
+        __s16 mod = -1;
 
         KeyTarget() {};
 
         KeyTarget(int key, int mod) : key(key), mod(mod) {}
+
+        bool mapped() const { return key >= 0; }
+    };
+
+    /**
+     * dense table from key code to target, indexed directly by the code.
+     * codes without a target hold an unmapped KeyTarget.
+     */
+    class KeyTable {
+        std::array<KeyTarget, KEY_CNT> targets;
+
+    public:
+        bool count(int code) const {
+            return valid_key(code) && targets[code].mapped();
+        }
+
+        // an unmapped target for codes that are not in the table
+        KeyTarget lookup(int code) const {
+            return valid_key(code) ? targets[code] : KeyTarget();
+        }
+
+        KeyTarget &operator[](int code) {
+            if (!valid_key(code)) {
+                throw std::out_of_range("key code out of range: " + std::to_string(code));
+            }
+            return targets[code];
+        }
+
+    };
+
+    /**
+     * the currently pressed keys as a sparse set: a compact list in press order plus
+     * the position of each code in that list. a press and all queries are O(1), a release and visiting the
+     * pressed keys are O(pressed): a release shifts the keys after it to keep the press order the snapshot saves.
+     */
+    class KeyState {
+        std::array<__s16, KEY_CNT> position;
+        std::array<__u16, KEY_CNT> pressed;
+        size_t length = 0;
+
+    public:
+        KeyState() {
+            position.fill(-1);
+        }
+
+        void set(int code, int value) {
+            if (!valid_key(code)) {
+                return;
+            }
+            if (value > 0 && position[code] < 0) {
+                position[code] = length;
+                pressed[length++] = code;
+            } else if (value == 0 && position[code] >= 0) {
+                // keep the press order, the list is only ever a few keys long
+                for (size_t i = position[code]; i + 1 < length; i++) {
+                    pressed[i] = pressed[i + 1];
+                    position[pressed[i]] = i;
+                }
+                position[code] = -1;
+                length--;
+            }
+        }
+
+        bool down(int code) const {
+            return valid_key(code) && position[code] >= 0;
+        }
+
+        bool any() const {
+            return length > 0;
+        }
+
+        void clear() {
+            for (size_t i = 0; i < length; i++) {
+                position[pressed[i]] = -1;
+            }
+            length = 0;
+        }
+
+        size_t count() const {
+            return length;
+        }
+
+        // calls f with every pressed code, in the order they were pressed
+        template<typename F>
+        void for_each(F f) const {
+            for (size_t i = 0; i < length; i++) {
+                f(int(pressed[i]));
+            }
+        }
+
     };
 
     class LayerConfig {
@@ -27,37 +130,119 @@ namespace schoenberg {
     public:
         string prefix;
 
-        std::map<int, KeyTarget> keys;
+        KeyTable keys;
+
+        // a tap of the prefix switches the layer on until it is tapped again, instead of writing the prefix key
+        bool toggle = false;
+
+
+        LayerConfig(const string &prefix, const KeyTable &keys) : prefix(prefix), keys(keys) {}
+
+    };
+
+    /**
+     * keys pressed together (in any order, within the combo term) that produce the target instead.
+     */
+    class ComboConfig {
+
+    public:
+        std::vector<int> keys;
 
+        KeyTarget target;
 
-        LayerConfig(const string &prefix, const map<int, KeyTarget> &keys) : prefix(prefix), keys(keys) {}
+        ComboConfig(const std::vector<int> &keys, const KeyTarget &target) : keys(keys), target(target) {}
 
     };
 
+    /**
+     * the combos compiled into a DFA over the set of combo keys pressed so far. a node is a set of keys
+     * that is part of at least one combo, node 0 is the empty set. every press costs one transition,
+     * no matter how many combos there are.
+     */
+    class ComboMachine {
+    public:
+        static constexpr size_t MAX_KEYS = 8;
+
+        // column of a key code in the transition table, -1 for keys that are in no combo
+        std::array<__s16, KEY_CNT> column;
+        size_t columns = 0;
+        // next[node * columns + column]: the node after pressing the key, 0 if no combo goes on with it
+        std::vector<__u16> next;
+        // per node: the combo it completes (unmapped if none) and whether more keys can follow
+        std::vector<KeyTarget> targets;
+        std::vector<__u8> extends;
+
+        ComboMachine() {
+            column.fill(-1);
+        }
+
+        bool empty() const { return columns == 0; }
+
+        int column_of(int code) const {
+            return valid_key(code) ? column[code] : -1;
+        }
+
+        int step(int node, int column) const {
+            return next[node * columns + column];
+        }
+    };
+
+    // throws invalid_argument for combos with less than two or more than MAX_KEYS keys and for duplicates
+    ComboMachine compile_combos(const std::vector<ComboConfig> &combos);
+
     class Config {
     public:
 
         std::vector<LayerConfig> layers;
-        std::map<int, KeyTarget> keys;
+        KeyTable keys;
 
-        Config(const vector<LayerConfig> &layers, const map<int, KeyTarget> &keys) : layers(layers), keys(keys) {}
+        std::vector<ComboConfig> combos;
+        // compiled from combos by read_config, recompile after changing them
+        ComboMachine machine;
+        // ms the keys of a combo may be pressed apart
+        uint32_t combo_term = 50;
+
+        // ms a layer prefix has to be held down to count as held, 0 decides on the next event (the old behaviour)
+        uint32_t tapping_term = 0;
+        // with a tapping term: a key pressed and released while the prefix is down decides for the layer
+        bool permissive_hold = false;
+
+        // repeats per second schoenberg generates for a held key instead of forwarding the repeats of the kernel,
+        // 0 forwards them
+        uint32_t repeat_rate = 0;
+        // ms a key is held before the generated repeats start
+        uint32_t repeat_delay = 250;
+
+        // built by generated::config() of a schoenberg_gen keymap, the compiled tables apply to it
+        bool compiled = false;
+
+        Config(const vector<LayerConfig> &layers, const KeyTable &keys) : layers(layers), keys(keys) {}
 
     };
 
     class LayerState {
 
     public:
-        bool active;
+        int code = -1;
+
+        // on the stack: held or toggled on
+        bool active = false;
 
-        bool used;
-        bool written;
+        bool used = false;
+        bool written = false;
 
-        std::map<int, KeyTarget> keys;
+        // the prefix is down
+        bool held = false;
+        bool toggle = false;
+        bool toggled = false;
+
+        KeyTable keys;
 
         LayerState() {};
 
 
-        LayerState(bool active, bool used, bool written, const map<int, KeyTarget> &keys) : active(active), used(used),
+        LayerState(int code, bool active, bool used, bool written, const KeyTable &keys) : code(code), active(active),
+                                                                                            used(used),
                                                                                             written(written),
                                                                                             keys(keys) {
 
@@ -65,34 +250,525 @@ namespace schoenberg {
 
     };
 
+    /**
+     * the layers in config order plus an index from prefix code to layer.
+     * the position of a layer is its bit in a stack mask, so there are at most 64.
+     */
+    class LayerTable {
+        std::vector<LayerState> layers;
+        std::array<__s8, KEY_CNT> index;
+
+    public:
+        LayerTable() {
+            index.fill(-1);
+        }
+
+        void add(const LayerState &layer) {
+            if (!valid_key(layer.code)) {
+                throw std::out_of_range("layer prefix out of range: " + std::to_string(layer.code));
+            }
+            if (index[layer.code] >= 0) {
+                throw std::invalid_argument("duplicate layer prefix: " + std::to_string(layer.code));
+            }
+            if (layers.size() >= 64) {
+                throw std::length_error("too many layers");
+            }
+            index[layer.code] = layers.size();
+            layers.push_back(layer);
+        }
+
+        bool count(int code) const {
+            return valid_key(code) && index[code] >= 0;
+        }
+
+        LayerState &operator[](int code) {
+            return at(code);
+        }
+
+        // position of the layer with this prefix in config order, -1 if there is none
+        int position(int code) const {
+            return valid_key(code) ? index[code] : -1;
+        }
+
+        LayerState &by_position(int position) {
+            return layers[position];
+        }
+
+        const LayerState &by_position(int position) const {
+            return layers[position];
+        }
+
+        LayerState &at(int code) {
+            if (!count(code)) {
+                throw std::out_of_range("no layer with prefix " + std::to_string(code));
+            }
+            return layers[index[code]];
+        }
+
+        size_t size() const { return layers.size(); }
+
+        std::vector<LayerState>::iterator begin() { return layers.begin(); }
+
+        std::vector<LayerState>::iterator end() { return layers.end(); }
+
+        std::vector<LayerState>::const_iterator begin() const { return layers.begin(); }
+
+        std::vector<LayerState>::const_iterator end() const { return layers.end(); }
+
+    };
+
+
+    /**
+     * what a key event turns into with a given layer active (or none), with the mapping and
+     * the layer keys already applied. steps[value] is the output for the event values 0, 1 and 2.
+     */
+    class Resolution {
+    public:
+        // the event involves a prefix key and has to take the general path
+        static constexpr __u8 GENERAL = 1;
+        // a press that is not mapped in the layer: an unused prefix is written before it
+        static constexpr __u8 TAP_PREFIX = 2;
+
+        class Step {
+        public:
+            __u16 code;
+            __s16 value;
+        };
+
+        __u8 flags = GENERAL;
+        __u8 count[3] = {};
+        // bit i: a frame ends after steps[value][i]
+        __u8 ends[3] = {};
+        Step steps[3][4];
+    };
+
+    // per key code, for one stack of layers
+    typedef std::array<Resolution, KEY_CNT> ResolutionTable;
+
+    /**
+     * a layer prefix that is down while its tapping term runs: it is not decided yet whether it is tapped
+     * (the prefix key is written) or held (its layer applies). the input events in between are held back
+     * and run through the engine once it is decided.
+     */
+    class PendingPrefix {
+    public:
+        static constexpr size_t CAPACITY = 32;
+
+        int code = -1;
+        // ns on the clock of the event timestamps
+        uint64_t deadline = 0;
+        size_t count = 0;
+        input_event events[CAPACITY];
+
+        bool active() const { return code >= 0; }
+
+        bool pressed(int key) const {
+            for (size_t i = 0; i < count; i++) {
+                if (events[i].code == key && events[i].value == 1) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    /**
+     * the combo keys pressed so far while it is not decided yet whether they are a combo (node > 0),
+     * and the keys of combos that fired and are still down.
+     */
+    class PendingCombo {
+    public:
+        int node = 0;
+        // ns on the clock of the event timestamps
+        uint64_t deadline = 0;
+        size_t count = 0;
+        input_event events[ComboMachine::MAX_KEYS];
+
+        // the target of the last fired combo while it is down, unmapped otherwise
+        KeyTarget held;
+        // keys of fired combos that are still down, their events are swallowed
+        std::bitset<KEY_CNT> consumed;
+        size_t consumed_count = 0;
+
+        bool active() const { return node > 0; }
+
+        bool holding(int code) const {
+            return consumed_count > 0 && valid_key(code) && consumed[code];
+        }
+
+        bool pressed(int key) const {
+            for (size_t i = 0; i < count; i++) {
+                if (events[i].code == key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    /**
+     * the key the kernel autorepeats: the input key pressed last and the output key its press wrote.
+     * a repeat writes that key again as long as it is down, whatever the layers did since.
+     */
+    class RepeatKey {
+    public:
+        int code = -1;
+        int key = -1;
+        // ns on the clock of the event timestamps, the next generated repeat. 0 if none is due
+        uint64_t deadline = 0;
+
+        bool active() const { return code >= 0; }
+    };
+
+    // the tables build_state resolves at most, one per stack of layers
+    constexpr size_t MAX_RESOLVED_STACKS = 128;
 
     class State {
 
     public:
-        std::map<int, int> key_state;
+        KeyState key_state;
+
+        LayerTable layers;
+
+        // position of the layer whose prefix was pressed last and is still down, -1 if no prefix is down.
+        // every other held layer is used already
+        int active_layer = -1;
+
+        // the active layers, bit i for the layer at position i. a key is looked up from the highest
+        // position down, keys a layer does not map fall through to the layers below it
+        uint64_t stack = 0;
+
+        // the resolution of the stacks build_state resolved: slot 0 for the empty stack, slot i + 1 for layer i
+        // alone, then the pairs of layers if there are at most MAX_RESOLVED_STACKS stacks in all
+        std::vector<ResolutionTable> resolved;
+        // the slot of each stack in resolved
+        std::unordered_map<uint64_t, int> slots;
+        // the slot of the stack it was selected for, -1 if that stack takes the general path
+        int slot = 0;
+        uint64_t slot_stack = 0;
+
+        // from the config, in ns. 0 turns the tap/hold decision by time off
+        uint64_t tapping_term = 0;
+        bool permissive_hold = false;
+        // in ns, 0 if there are no combos
+        uint64_t combo_term = 0;
+        // in ns, 0 forwards the repeats of the kernel
+        uint64_t repeat_interval = 0;
+        uint64_t repeat_delay = 0;
+        // the time of the event being processed, or of the last expire. the only clock the engine reads
+        uint64_t now = 0;
+        PendingPrefix pending;
+        PendingCombo combo;
+        RepeatKey repeat;
+
+        State(const LayerTable &layers) : layers(layers) {}
+
+        // the engine waits for time: it has to be told the time with expire
+        bool timed() const {
+            return tapping_term > 0 || combo_term > 0 || repeat_interval > 0;
+        }
+
+        LayerState *active() {
+            return active_layer >= 0 ? &layers.by_position(active_layer) : nullptr;
+        }
 
-        std::map<int, LayerState> layers;
 
-        State(const map<int, int> keyState, const map<int, LayerState> &layers) : key_state(
-                keyState),
-                                                                                  layers(layers) {}
+    };
+
+
+    /**
+     * caller owned, fixed capacity buffer the engine appends its output events to.
+     * nothing is allocated on push, running out of capacity is a programming error.
+     * the events are split into frames: where a consumer has to see a SYN_REPORT between two events
+     * (a modifier before its key, the press and release of a tap) the engine ends the frame.
+     * the last frame stays open, it is ended by the SYN_REPORT of the input.
+     */
+    class OutputSpan {
+
+    public:
+        input_event *events;
+        // one bit per event, set if the event ends a frame
+        uint64_t *ends;
+        size_t capacity;
+        size_t length = 0;
+
+        OutputSpan(input_event *events, uint64_t *ends, size_t capacity) : events(events), ends(ends),
+                                                                           capacity(capacity) {}
+
+        OutputSpan(const OutputSpan &) = delete;
+
+        OutputSpan &operator=(const OutputSpan &) = delete;
+
+        void push(const input_event &event) {
+            if (length == capacity) {
+                throw std::length_error("output span is full");
+            }
+            if (length % 64 == 0) {
+                ends[length / 64] = 0;
+            }
+            events[length++] = event;
+        }
+
+        // a run of events in one copy
+        void push(const input_event *first, size_t count) {
+            if (capacity - length < count) {
+                throw std::length_error("output span is full");
+            }
+            for (auto word = (length + 63) / 64; word * 64 < length + count; word++) {
+                ends[word] = 0;
+            }
+            std::memcpy(events + length, first, count * sizeof(input_event));
+            length += count;
+        }
+
+        // the events so far are a frame of their own. empty frames are never produced
+        void end_frame() {
+            if (length > 0) {
+                ends[(length - 1) / 64] |= uint64_t(1) << ((length - 1) % 64);
+            }
+        }
+
+        bool frame_end(size_t i) const {
+            return ends[i / 64] >> (i % 64) & 1;
+        }
+
+        // calls f(first, count) for every frame, the last one is the open frame and may be empty
+        template<typename F>
+        void for_each_frame(F f) const {
+            size_t start = 0;
+            for (size_t i = 0; i < length; i++) {
+                if (frame_end(i)) {
+                    f(events + start, i + 1 - start);
+                    start = i + 1;
+                }
+            }
+            f(events + start, length - start);
+        }
 
+        void clear() { length = 0; }
 
+        size_t size() const { return length; }
+
+        bool empty() const { return length == 0; }
+
+        const input_event &operator[](size_t i) const { return events[i]; }
+
+        const input_event *begin() const { return events; }
+
+        const input_event *end() const { return events + length; }
+
+    };
+
+    // the most events a single input event can produce: every key released at once plus the synthetic ones
+    constexpr size_t MAX_OUTPUT_EVENTS = KEY_CNT + 8;
+
+    template<size_t N = MAX_OUTPUT_EVENTS>
+    class OutputBuffer : public OutputSpan {
+        input_event storage[N];
+        uint64_t frame_ends[(N + 63) / 64];
+
+    public:
+        OutputBuffer() : OutputSpan(storage, frame_ends, N) {}
+    };
+
+    // the resolution of a key neither the mapping nor the stack maps: it is written as it is
+    constexpr Resolution pass_through(int code, __u8 flags) {
+        Resolution resolution{};
+        resolution.flags = flags;
+        for (int value = 0; value <= 2; value++) {
+            resolution.count[value] = 1;
+            resolution.steps[value][0] = {__u16(code), __s16(value)};
+        }
+        return resolution;
+    }
+
+    /**
+     * the fast path: writes the resolution of a key event (value 0 to 2) with the current stack, which has
+     * to be one without the GENERAL flag. inline, so a constant resolution folds into its caller.
+     */
+    template<typename Log>
+    inline size_t apply_resolution(State &state, const Resolution &resolution, const input_event &event,
+                                   OutputSpan &out, Log &log) {
+        auto start = out.size();
+        auto layer = state.active();
+        if (layer && event.value == 1 && resolution.flags & Resolution::TAP_PREFIX && !layer->used &&
+            !layer->toggle) {
+            log(LogTag::WRITTEN_NOW_DOWN, layer->code, 1);
+            out.push(input_event{.type = EV_KEY, .code = __u16(layer->code), .value = 1});
+            out.end_frame();
+            log(LogTag::WRITTEN_NOW_UP, layer->code, 0);
+            out.push(input_event{.type = EV_KEY, .code = __u16(layer->code), .value = 0});
+            layer->written = true;
+        }
+        for (int i = 0; i < resolution.count[event.value]; i++) {
+            const auto &step = resolution.steps[event.value][i];
+            log(LogTag::RESOLVED, step.code, step.value);
+            out.push(input_event{.type = EV_KEY, .code = step.code, .value = step.value});
+            if (resolution.ends[event.value] >> i & 1) {
+                out.end_frame();
+            }
+        }
+        if (layer && event.value == 1) {
+            layer->used = true;
+        }
+        for (auto i = start; i < out.size(); i++) {
+            state.key_state.set(out[i].code, out[i].value);
+        }
+        return out.size() - start;
+    }
+
+    /**
+     * a press of code wrote key (-1 for none): its repeats repeat key from now on. when the engine generates
+     * the repeats the first one is due after the repeat delay.
+     */
+    inline void hold_repeat(State &state, int code, int key) {
+        state.repeat.code = key >= 0 ? code : -1;
+        state.repeat.key = key;
+        state.repeat.deadline = state.repeat_interval && key >= 0 ? state.now + state.repeat_delay : 0;
+    }
+
+    /**
+     * keeps State::repeat up to date after a key event wrote out from `from` on: a press makes the last key
+     * it pressed the one that repeats, its release ends the repeats. like the kernel, the generated repeats
+     * stop at any release.
+     */
+    inline void track_repeat(State &state, const input_event &event, const OutputSpan &out, size_t from) {
+        if (event.value == 1) {
+            auto key = -1;
+            for (auto i = out.size(); i > from && key < 0; i--) {
+                key = out[i - 1].value == 1 ? out[i - 1].code : -1;
+            }
+            hold_repeat(state, event.code, key);
+        } else if (event.value == 0) {
+            if (event.code == state.repeat.code) {
+                state.repeat = RepeatKey();
+            }
+            state.repeat.deadline = 0;
+        }
+    }
+
+
+    /**
+     * runs an event through the mapping and the layers and appends the result to out.
+     * returns the number of appended events. this never allocates, apart from resolving a stack of
+     * layers the first time it is active.
+     * the logger is a template parameter (NoLog, StreamLog or TraceLog), with NoLog all logging compiles away.
+     */
+    template<typename Log = NoLog, typename = decltype(Log::enabled)>
+    size_t process(Config &config, State &state, input_event event, OutputSpan &out, Log log = Log());
+
+    size_t process(Config &config, State &state, input_event event, OutputSpan &out, std::ostream &logs);
+
+    /**
+     * where a batch stopped inside a frame of the input, for the batch that goes on with it.
+     */
+    class BatchFrame {
+    public:
+        // the frame has keys or scan codes: its SYN_REPORT is dropped if nothing of it was written
+        bool keys = false;
+        bool written = false;
     };
 
+    // an output buffer that lets a batch take a few thousand events per call
+    constexpr size_t BATCH_OUTPUT_EVENTS = 4096;
+
+    /**
+     * runs a batch of input events the way the pipeline forwards single events: scan codes are dropped,
+     * events that are not keys are copied as they are, keys go through the engine and their output gets
+     * their timestamp. like for a single event the engine ends frames in out, the SYN_REPORTs of the input are
+     * copied as events, except the one of a frame that was swallowed completely.
+     * stops before a key event when out may not hold its output, returns the number of input events taken.
+     */
+    template<typename Log = NoLog, typename = decltype(Log::enabled)>
+    size_t process_batch(Config &config, State &state, const input_event *events, size_t count, OutputSpan &out,
+                         BatchFrame &frame, Log log = Log());
+
+    /**
+     * sorts up to 64 events by type: bit i of keys is set for a key event, of scans for a MSC_SCAN
+     * and of syns for a SYN_REPORT. uses AVX2 gathers when the cpu has them.
+     */
+    void classify(const input_event *events, size_t count, uint64_t &keys, uint64_t &scans, uint64_t &syns);
+
+    // classify without SIMD
+    void classify_scalar(const input_event *events, size_t count, uint64_t &keys, uint64_t &scans, uint64_t &syns);
+
+    // when the engine wants to be called with expire, 0 if it does not wait for anything
+    inline uint64_t next_deadline(const State &state) {
+        uint64_t res = 0;
+        for (auto deadline: {state.pending.active() ? state.pending.deadline : 0,
+                             state.combo.active() ? state.combo.deadline : 0, state.repeat.deadline}) {
+            if (deadline && (!res || deadline < res)) {
+                res = deadline;
+            }
+        }
+        return res;
+    }
+
+    /**
+     * tells the engine the time is now (ns, the clock of the event timestamps) without an event.
+     * a tapping term that ran out is decided as a hold, a combo term that ran out fires a completed combo
+     * or lets the keys through, and the held back events are processed. a due repeat of the held key is written.
+     * returns the number of appended events.
+     */
+    template<typename Log = NoLog, typename = decltype(Log::enabled)>
+    size_t expire(Config &config, State &state, uint64_t now, OutputSpan &out, Log log = Log());
+
+    size_t process_for_layer(State &state, input_event event, OutputSpan &out, std::ostream &logs);
+
+    size_t process_mapping(Config &config, input_event event, OutputSpan &out, std::ostream &logs);
 
     vector<input_event> process_for_layer(State &state, input_event event, std::ostream &logs);
 
     vector<input_event> process_mapping(Config &config,input_event event, std::ostream &logs);
 
-    int parse_key(string keyCode);
+    // the code of a key name as in linux/input-event-codes.h without KEY_ ("ESC", "BTN_LEFT"), -1 if unknown
+    int parse_key(std::string_view keyCode);
 
+    // the name of a key code, empty if the code has none. does not allocate
+    std::string_view key_name(int code);
+
+    // like key_name, unknown codes become UNKNOWN(code)
     string serialize_key(int code);
 
     Config read_config(const string &file);
 
     State build_state(const Config &config);
 
+    /**
+     * a keymap together with the state it is running with.
+     */
+    class Engine {
+
+    public:
+        Config config;
+        State state;
+
+        explicit Engine(const Config &config) : config(config), state(build_state(this->config)) {}
+
+        // nothing is held: the engine can be replaced without leaving keys or layers stuck.
+        // a toggled layer stays on in the engine, see adopt_toggles for one that replaces it
+        bool idle() const {
+            return !state.key_state.any() && state.active_layer < 0 && !state.combo.active() &&
+                   state.combo.consumed_count == 0;
+        }
+
+        // switches on the toggle layers that are toggled on in other, by prefix. a layer this config
+        // does not have as a toggle layer stays off
+        void adopt_toggles(const Engine &other) {
+            for (size_t i = 0; i < other.state.layers.size(); i++) {
+                const auto &toggled = other.state.layers.by_position(i);
+                auto position = state.layers.position(toggled.code);
+                if (!toggled.toggled || position < 0 || !state.layers.by_position(position).toggle) {
+                    continue;
+                }
+                auto &layer = state.layers.by_position(position);
+                layer.toggled = layer.active = true;
+                state.stack |= uint64_t(1) << position;
+            }
+        }
+
+    };
+
 
 };
 
@@ -0,0 +1,197 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <type_traits>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace schoenberg;
+
+static_assert(std::is_trivially_copyable<SnapshotData>::value, "the snapshot is copied as it is in memory");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence is shared between processes");
+
+constexpr char StateSnapshot::MAGIC[8];
+
+namespace {
+
+    // FNV-1a
+    class Hash {
+    public:
+        uint64_t value = 14695981039346656037ull;
+
+        void add(const void *bytes, size_t length) {
+            auto p = static_cast<const unsigned char *>(bytes);
+            for (size_t i = 0; i < length; i++) {
+                value = (value ^ p[i]) * 1099511628211ull;
+            }
+        }
+
+        template<typename T>
+        void add(const T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "hashed as it is in memory");
+            add(&value, sizeof(value));
+        }
+    };
+
+    std::string shm_name(const std::string &name) {
+        return name.empty() || name[0] != '/' ? "/" + name : name;
+    }
+
+    bool fits(const StateSnapshot &snapshot) {
+        return std::memcmp(snapshot.magic, StateSnapshot::MAGIC, sizeof(snapshot.magic)) == 0 &&
+               snapshot.version == StateSnapshot::VERSION && snapshot.key_count == KEY_CNT &&
+               snapshot.size == sizeof(StateSnapshot);
+    }
+
+}
+
+uint64_t schoenberg::fingerprint(const Config &config) {
+    Hash hash;
+    hash.add(config.keys);
+    for (const auto &layer: config.layers) {
+        hash.add(layer.prefix.data(), layer.prefix.size() + 1);
+        hash.add(layer.toggle);
+        hash.add(layer.keys);
+    }
+    for (const auto &combo: config.combos) {
+        hash.add(combo.keys.data(), combo.keys.size() * sizeof(int));
+        hash.add(combo.target);
+    }
+    hash.add(config.combo_term);
+    hash.add(config.tapping_term);
+    hash.add(config.permissive_hold);
+    hash.add(config.repeat_rate);
+    hash.add(config.repeat_delay);
+    // 0 marks a snapshot without a state
+    return hash.value ? hash.value : 1;
+}
+
+void StateSnapshot::save(const State &state, uint64_t fingerprint) {
+    // odd while writing, also after a writer that died in the middle of a save
+    auto sequence = this->sequence.load(std::memory_order_relaxed) | 1;
+    this->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    data.fingerprint = fingerprint;
+    data.down_count = 0;
+    state.key_state.for_each([&](int code) { data.down[data.down_count++] = code; });
+    data.active_layer = state.active_layer;
+    data.stack = state.stack;
+    data.layer_count = state.layers.size();
+    for (size_t i = 0; i < data.layer_count && i < SnapshotData::MAX_LAYERS; i++) {
+        const auto &layer = state.layers.by_position(i);
+        data.layers[i] = {int16_t(layer.code), layer.active, layer.used, layer.written, layer.held, layer.toggled};
+    }
+    data.repeat = state.repeat;
+    // only the events that are there, the pending buffers are mostly empty
+    data.pending.code = state.pending.code;
+    data.pending.deadline = state.pending.deadline;
+    data.pending.count = state.pending.count;
+    std::copy(state.pending.events, state.pending.events + state.pending.count, data.pending.events);
+    data.combo.node = state.combo.node;
+    data.combo.deadline = state.combo.deadline;
+    data.combo.count = state.combo.count;
+    std::copy(state.combo.events, state.combo.events + state.combo.count, data.combo.events);
+    data.combo.held = state.combo.held;
+    data.combo.consumed = state.combo.consumed;
+    data.combo.consumed_count = state.combo.consumed_count;
+
+    this->sequence.store(sequence + 1, std::memory_order_release);
+}
+
+bool StateSnapshot::restore(State &state, uint64_t fingerprint) const {
+    if (!fits(*this)) {
+        return false;
+    }
+    // a copy that was not written to while it was taken. a save takes well below a microsecond,
+    // a sequence that stays odd is from a writer that died while saving
+    SnapshotData copy;
+    auto consistent = false;
+    for (int attempt = 0; attempt < 1000 && !consistent; attempt++) {
+        auto before = sequence.load(std::memory_order_acquire);
+        if (before % 2) {
+            continue;
+        }
+        std::memcpy(&copy, &data, sizeof(copy));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        consistent = sequence.load(std::memory_order_relaxed) == before;
+    }
+    if (!consistent || copy.fingerprint != fingerprint || copy.layer_count != state.layers.size() ||
+        copy.layer_count > SnapshotData::MAX_LAYERS || copy.down_count > KEY_CNT) {
+        return false;
+    }
+    for (size_t i = 0; i < copy.layer_count; i++) {
+        if (copy.layers[i].code != state.layers.by_position(i).code) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < copy.down_count; i++) {
+        state.key_state.set(copy.down[i], 1);
+    }
+    for (size_t i = 0; i < copy.layer_count; i++) {
+        auto &layer = state.layers.by_position(i);
+        layer.active = copy.layers[i].active;
+        layer.used = copy.layers[i].used;
+        layer.written = copy.layers[i].written;
+        layer.held = copy.layers[i].held;
+        layer.toggled = copy.layers[i].toggled;
+    }
+    // the slot of the stack is selected again on the next event
+    state.active_layer = copy.active_layer;
+    state.stack = copy.stack;
+    state.repeat = copy.repeat;
+    state.pending = copy.pending;
+    state.combo = copy.combo;
+    return true;
+}
+
+StateSegment StateSegment::open(const std::string &name) {
+    auto fd = shm_open(shm_name(name).c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("can not open the state segment " + name + ": " + strerror(errno));
+    }
+    struct stat info;
+    auto res = fstat(fd, &info);
+    if (res == 0 && size_t(info.st_size) != sizeof(StateSnapshot)) {
+        res = ftruncate(fd, sizeof(StateSnapshot));
+    }
+    auto memory = res == 0 ? mmap(nullptr, sizeof(StateSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                           : MAP_FAILED;
+    auto error = errno;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("can not map the state segment " + name + ": " + strerror(error));
+    }
+    auto snapshot = static_cast<StateSnapshot *>(memory);
+    if (!fits(*snapshot)) {
+        // new, or left by a build with another layout: there is nothing to adopt
+        std::memset(snapshot->magic, 0, sizeof(snapshot->magic));
+        snapshot->version = StateSnapshot::VERSION;
+        snapshot->key_count = KEY_CNT;
+        snapshot->size = sizeof(StateSnapshot);
+        snapshot->sequence.store(0, std::memory_order_relaxed);
+        snapshot->data.fingerprint = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(snapshot->magic, StateSnapshot::MAGIC, sizeof(snapshot->magic));
+    }
+    return StateSegment(snapshot);
+}
+
+StateSegment::StateSegment(StateSnapshot *snapshot) : snapshot(snapshot) {}
+
+StateSegment::StateSegment(StateSegment &&other) noexcept: snapshot(other.snapshot), saved(other.saved),
+                                                          saved_fingerprint(other.saved_fingerprint) {
+    other.snapshot = nullptr;
+}
+
+StateSegment::~StateSegment() {
+    // the segment stays for the next process
+    if (snapshot) {
+        munmap(snapshot, sizeof(StateSnapshot));
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "schoenberg.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace schoenberg {
+
+    // a hash of everything in the config the state depends on: a state is only adopted by an engine of the same config
+    uint64_t fingerprint(const Config &config);
+
+    class SnapshotLayer {
+    public:
+        int16_t code;
+        uint8_t active;
+        uint8_t used;
+        uint8_t written;
+        uint8_t held;
+        uint8_t toggled;
+    };
+
+    // the part of a State that changes with the events, the tables are built again from the config
+    class SnapshotData {
+    public:
+        static constexpr size_t MAX_LAYERS = 64;
+
+        // of the config the state belongs to, 0 if nothing was saved
+        uint64_t fingerprint;
+        // the keys written as down, in press order
+        uint32_t down_count;
+        uint16_t down[KEY_CNT];
+        int32_t active_layer;
+        uint32_t layer_count;
+        uint64_t stack;
+        SnapshotLayer layers[MAX_LAYERS];
+        RepeatKey repeat;
+        PendingPrefix pending;
+        PendingCombo combo;
+    };
+
+    /**
+     * the live state of the engine in shared memory, in a fixed layout. the event loop saves it after every batch,
+     * a new process started with the same segment and config adopts it: the keys and layers held across the restart
+     * are released the way they were pressed, the prefix waiting for its tapping term is still decided.
+     *
+     * the writer publishes with a sequence number (seqlock): odd while it writes, a reader copies the data and
+     * retries if the sequence changed in between.
+     */
+    class StateSnapshot {
+    public:
+        static constexpr char MAGIC[8] = "SCHSNAP";
+        // bump whenever the layout of the snapshot or of the classes in it changes
+        static constexpr uint32_t VERSION = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t key_count;
+        uint32_t size;
+        std::atomic<uint64_t> sequence;
+        SnapshotData data;
+
+        void save(const State &state, uint64_t fingerprint);
+
+        // copies the saved state into a state built from a config with the given fingerprint, false if it does not fit
+        bool restore(State &state, uint64_t fingerprint) const;
+    };
+
+    /**
+     * the shm segment of a StateSnapshot, it outlives the process so the next one can adopt the state.
+     */
+    class StateSegment {
+    public:
+        // maps the segment, creates it if there is none or it has another layout. throws if that is not possible
+        static StateSegment open(const std::string &name);
+
+        StateSegment(StateSegment &&other) noexcept;
+
+        ~StateSegment();
+
+        StateSegment(const StateSegment &) = delete;
+
+        StateSegment &operator=(const StateSegment &) = delete;
+
+        // the fingerprint is only computed again when the engine changes (a reload or another profile)
+        void save(const Engine &engine) {
+            if (&engine != saved) {
+                saved = &engine;
+                saved_fingerprint = fingerprint(engine.config);
+            }
+            snapshot->save(engine.state, saved_fingerprint);
+        }
+
+        bool restore(Engine &engine) const {
+            return snapshot->restore(engine.state, fingerprint(engine.config));
+        }
+
+        StateSnapshot *snapshot = nullptr;
+
+    private:
+        explicit StateSegment(StateSnapshot *snapshot);
+
+        // the engine saved last, it is alive until the next one is built, so a new engine never has its address
+        const Engine *saved = nullptr;
+        uint64_t saved_fingerprint = 0;
+    };
+
+};
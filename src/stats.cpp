@@ -0,0 +1,116 @@
+#include "stats.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace schoenberg;
+
+constexpr char LatencyHistogram::MAGIC[8];
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    auto total = count.load(std::memory_order_relaxed);
+    if (total == 0) {
+        return 0;
+    }
+    auto target = uint64_t(fraction * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen > target) {
+            return bucket_floor(i);
+        }
+    }
+    return max.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+    for (auto &counter: counts) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+    skewed.store(0, std::memory_order_relaxed);
+}
+
+namespace {
+
+    std::string shm_name(const std::string &name) {
+        return name.empty() || name[0] != '/' ? "/" + name : name;
+    }
+
+}
+
+StatsSegment StatsSegment::create(const std::string &name, clockid_t clock) {
+    auto fd = shm_open(shm_name(name).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("can not create the stats segment " + name + ": " + strerror(errno));
+    }
+    auto res = ftruncate(fd, sizeof(LatencyHistogram));
+    auto memory = res == 0 ? mmap(nullptr, sizeof(LatencyHistogram), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                           : MAP_FAILED;
+    auto error = errno;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("can not map the stats segment " + name + ": " + strerror(error));
+    }
+    auto histogram = static_cast<LatencyHistogram *>(memory);
+    std::memset(histogram->magic, 0, sizeof(histogram->magic));
+    histogram->reset();
+    histogram->version = LatencyHistogram::VERSION;
+    histogram->buckets = LatencyHistogram::BUCKETS;
+    histogram->clock = clock;
+    // the magic last, a reader never sees a half initialized segment as valid
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(histogram->magic, LatencyHistogram::MAGIC, sizeof(histogram->magic));
+    return StatsSegment(name, histogram, true);
+}
+
+StatsSegment StatsSegment::open(const std::string &name) {
+    auto fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw std::runtime_error("no stats segment " + name + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || size_t(info.st_size) < sizeof(LatencyHistogram)) {
+        close(fd);
+        throw std::runtime_error("the stats segment " + name + " is too small");
+    }
+    auto memory = mmap(nullptr, sizeof(LatencyHistogram), PROT_READ, MAP_SHARED, fd, 0);
+    auto error = errno;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("can not map the stats segment " + name + ": " + strerror(error));
+    }
+    auto histogram = static_cast<LatencyHistogram *>(memory);
+    if (std::memcmp(histogram->magic, LatencyHistogram::MAGIC, sizeof(histogram->magic)) != 0 ||
+        histogram->version != LatencyHistogram::VERSION || histogram->buckets != LatencyHistogram::BUCKETS) {
+        munmap(memory, sizeof(LatencyHistogram));
+        throw std::runtime_error("the stats segment " + name + " has an unknown layout");
+    }
+    return StatsSegment(name, histogram, false);
+}
+
+StatsSegment::StatsSegment(const std::string &name, LatencyHistogram *histogram, bool owner) : histogram(histogram),
+                                                                                              name(name),
+                                                                                              owner(owner) {}
+
+StatsSegment::StatsSegment(StatsSegment &&other) noexcept: histogram(other.histogram), name(std::move(other.name)),
+                                                            owner(other.owner) {
+    other.histogram = nullptr;
+    other.owner = false;
+}
+
+StatsSegment::~StatsSegment() {
+    if (!histogram) {
+        return;
+    }
+    munmap(histogram, sizeof(LatencyHistogram));
+    if (owner) {
+        shm_unlink(shm_name(name).c_str());
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+#include <sys/time.h>
+
+namespace schoenberg {
+
+    /**
+     * HDR style histogram of latencies in ns: values below 8 have a bucket each, above that every power of two
+     * is split into 8 buckets, so a bucket is at most 12.5% wide. covers up to 2^40 ns (18 minutes).
+     *
+     * the layout is shared memory: there is exactly one writer (the event loop), which updates the counters with
+     * relaxed loads and stores instead of read-modify-write instructions. readers in other processes may see a
+     * bucket and the count slightly apart, which is fine for statistics.
+     */
+    class LatencyHistogram {
+    public:
+        static constexpr char MAGIC[8] = "SCHSTAT";
+        static constexpr uint32_t VERSION = 1;
+        static constexpr int SUB_BITS = 3;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+        static constexpr int MAX_BITS = 40;
+        static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t buckets;
+        // the clock the source timestamps were compared against
+        int32_t clock;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+        // source timestamps in the future, the clock of the source is not the one measured against
+        std::atomic<uint64_t> skewed;
+        std::atomic<uint64_t> counts[BUCKETS];
+
+        static size_t bucket(uint64_t ns) {
+            if (ns < SUB_BUCKETS) {
+                return ns;
+            }
+            int top = 63 - __builtin_clzll(ns);
+            if (top >= MAX_BITS) {
+                return BUCKETS - 1;
+            }
+            return (top - SUB_BITS + 1) * SUB_BUCKETS + ((ns >> (top - SUB_BITS)) & (SUB_BUCKETS - 1));
+        }
+
+        // the smallest value that falls into the bucket
+        static uint64_t bucket_floor(size_t index) {
+            if (index < SUB_BUCKETS) {
+                return index;
+            }
+            auto top = index / SUB_BUCKETS + SUB_BITS - 1;
+            return (uint64_t(SUB_BUCKETS) | index % SUB_BUCKETS) << (top - SUB_BITS);
+        }
+
+        void record(uint64_t ns) {
+            bump(counts[bucket(ns)], 1);
+            bump(count, 1);
+            bump(sum, ns);
+            if (ns > max.load(std::memory_order_relaxed)) {
+                max.store(ns, std::memory_order_relaxed);
+            }
+        }
+
+        // the time from the timestamp of an event to now, events without a timestamp are not counted
+        void record_since(const timeval &time, const timespec &now) {
+            if (time.tv_sec == 0 && time.tv_usec == 0) {
+                return;
+            }
+            auto ns = (int64_t(now.tv_sec) - time.tv_sec) * 1000000000 + now.tv_nsec - int64_t(time.tv_usec) * 1000;
+            if (ns < 0) {
+                bump(skewed, 1);
+                return;
+            }
+            record(ns);
+        }
+
+        // the lower bound of the bucket that holds the given fraction of the samples
+        uint64_t percentile(double fraction) const;
+
+        void reset();
+
+    private:
+        // only the single writer changes the counters, a plain load and store is enough
+        static void bump(std::atomic<uint64_t> &counter, uint64_t by) {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * a LatencyHistogram in a POSIX shared memory segment (/dev/shm/NAME).
+     * the event loop creates it writable and removes it on exit, schoenberg_stats maps it read only.
+     */
+    class StatsSegment {
+    public:
+        // creates (or takes over) the segment, throws if that is not possible
+        static StatsSegment create(const std::string &name, clockid_t clock);
+
+        // maps an existing segment read only, throws if there is none or it has another layout
+        static StatsSegment open(const std::string &name);
+
+        StatsSegment(StatsSegment &&other) noexcept;
+
+        ~StatsSegment();
+
+        StatsSegment(const StatsSegment &) = delete;
+
+        StatsSegment &operator=(const StatsSegment &) = delete;
+
+        LatencyHistogram *histogram = nullptr;
+
+    private:
+        StatsSegment(const std::string &name, LatencyHistogram *histogram, bool owner);
+
+        std::string name;
+        bool owner = false;
+    };
+
+};
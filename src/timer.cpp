@@ -0,0 +1,47 @@
+#include "timer.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+using namespace schoenberg;
+
+DeadlineTimer::DeadlineTimer(clockid_t clock) : clock(clock) {
+    fd = timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("can not create a timer: ") + strerror(errno));
+    }
+}
+
+DeadlineTimer::~DeadlineTimer() {
+    close(fd);
+}
+
+void DeadlineTimer::arm(uint64_t deadline) {
+    if (deadline == armed) {
+        return;
+    }
+    itimerspec spec{};
+    spec.it_value.tv_sec = deadline / 1000000000;
+    spec.it_value.tv_nsec = deadline % 1000000000;
+    // an all zero it_value disarms
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    armed = deadline;
+}
+
+bool DeadlineTimer::fired() {
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return false;
+    }
+    armed = 0;
+    return true;
+}
+
+uint64_t DeadlineTimer::now() const {
+    timespec now;
+    clock_gettime(clock, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+namespace schoenberg {
+
+    /**
+     * a timerfd for the deadlines of the engine, armed at an absolute time on the clock of the event timestamps.
+     * the event loop polls fd next to the input, so a decision happens exactly at the deadline.
+     */
+    class DeadlineTimer {
+    public:
+        explicit DeadlineTimer(clockid_t clock);
+
+        ~DeadlineTimer();
+
+        DeadlineTimer(const DeadlineTimer &) = delete;
+
+        DeadlineTimer &operator=(const DeadlineTimer &) = delete;
+
+        // ns, 0 disarms. re-arming for the same deadline costs no syscall
+        void arm(uint64_t deadline);
+
+        // consumes the expiration once fd is readable, false if there was none
+        bool fired();
+
+        uint64_t now() const;
+
+        int fd = -1;
+        clockid_t clock;
+
+    private:
+        uint64_t armed = 0;
+    };
+
+};
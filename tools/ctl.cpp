@@ -0,0 +1,28 @@
+#include "profile.h"
+#include <iostream>
+
+using namespace std;
+using namespace schoenberg;
+
+void usage(const char *name) {
+    cerr << "usage: " << name << " SOCKET [PROFILE]" << endl;
+    cerr << "switches the schoenberg_run started with --control SOCKET to PROFILE, without PROFILE it lists the"
+         << endl;
+    cerr << "profiles. the switch takes effect as soon as no key is held." << endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3 || string(argv[1]) == "--help") {
+        usage(argv[0]);
+        return 1;
+    }
+    try {
+        auto reply = control_request(argv[1], argc == 3 ? string("use ") + argv[2] : "list");
+        auto failed = reply.rfind("error", 0) == 0;
+        (failed ? cerr : cout) << reply;
+        return failed ? 1 : 0;
+    } catch (const std::exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
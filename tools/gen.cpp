@@ -0,0 +1,209 @@
+#include "schoenberg.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace schoenberg;
+
+void usage(const char *name) {
+    cerr << "usage: " << name << " CONFIG HEADER" << endl;
+    cerr << "compiles the keymap in CONFIG into the C++ header HEADER. a schoenberg_run built with" << endl;
+    cerr << "-DSCHOENBERG_KEYMAP=CONFIG includes it: the config is compiled in and the fast path reads" << endl;
+    cerr << "constant tables instead of the ones built at startup. the per key work stays the same." << endl;
+}
+
+string target(const KeyTarget &target) {
+    return "KeyTarget(" + to_string(target.key) + ", " + to_string(target.mod) + ")";
+}
+
+string comment(int code, const KeyTarget &target) {
+    auto res = " // " + serialize_key(code) + ": " + serialize_key(target.key);
+    if (target.mod >= 0) {
+        res += " with " + serialize_key(target.mod);
+    }
+    return res;
+}
+
+string quoted(const string &s) {
+    string res = "\"";
+    for (auto c: s) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+        }
+        res += c;
+    }
+    return res + "\"";
+}
+
+bool same(const Resolution &a, const Resolution &b) {
+    if (a.flags != b.flags) {
+        return false;
+    }
+    if (a.flags & Resolution::GENERAL) {
+        return true;
+    }
+    for (int value = 0; value <= 2; value++) {
+        if (a.count[value] != b.count[value] || a.ends[value] != b.ends[value]) {
+            return false;
+        }
+        for (int i = 0; i < a.count[value]; i++) {
+            if (a.steps[value][i].code != b.steps[value][i].code ||
+                a.steps[value][i].value != b.steps[value][i].value) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+string literal(const Resolution &resolution) {
+    ostringstream res;
+    res << "{" << int(resolution.flags) << ", {";
+    for (int value = 0; value <= 2; value++) {
+        res << (value ? ", " : "") << int(resolution.count[value]);
+    }
+    res << "}, {";
+    for (int value = 0; value <= 2; value++) {
+        res << (value ? ", " : "") << int(resolution.ends[value]);
+    }
+    res << "}, {";
+    for (int value = 0; value <= 2; value++) {
+        res << (value ? ", " : "") << "{";
+        for (int i = 0; i < resolution.count[value]; i++) {
+            const auto &step = resolution.steps[value][i];
+            res << (i ? ", " : "") << "{" << step.code << ", " << step.value << "}";
+        }
+        res << "}";
+    }
+    res << "}}";
+    return res.str();
+}
+
+void write_keys(ostream &out, const string &table, const KeyTable &keys) {
+    for (int code = 0; code < KEY_CNT; code++) {
+        auto key = keys.lookup(code);
+        if (key.mapped()) {
+            out << "            " << table << "[" << code << "] = " << target(key) << ";" << comment(code, key)
+                << "\n";
+        }
+    }
+}
+
+void write_config(ostream &out, const Config &config) {
+    out << "        inline Config config() {\n";
+    out << "            vector<LayerConfig> layers;\n";
+    out << "            KeyTable keys;\n";
+    for (const auto &layer: config.layers) {
+        out << "            layers.emplace_back(" << quoted(layer.prefix) << ", KeyTable());\n";
+        if (layer.toggle) {
+            out << "            layers.back().toggle = true;\n";
+        }
+        write_keys(out, "layers.back().keys", layer.keys);
+    }
+    write_keys(out, "keys", config.keys);
+    out << "            Config config(layers, keys);\n";
+    out << "            config.tapping_term = " << config.tapping_term << ";\n";
+    out << "            config.permissive_hold = " << (config.permissive_hold ? "true" : "false") << ";\n";
+    out << "            config.combo_term = " << config.combo_term << ";\n";
+    out << "            config.repeat_rate = " << config.repeat_rate << ";\n";
+    out << "            config.repeat_delay = " << config.repeat_delay << ";\n";
+    out << "            config.compiled = true;\n";
+    for (const auto &combo: config.combos) {
+        out << "            config.combos.emplace_back(vector<int>{";
+        for (size_t i = 0; i < combo.keys.size(); i++) {
+            out << (i ? ", " : "") << combo.keys[i];
+        }
+        out << "}, " << target(combo.target) << ");\n";
+    }
+    out << "            config.machine = compile_combos(config.combos);\n";
+    out << "            return config;\n";
+    out << "        }\n";
+}
+
+/**
+ * the tables start out with every key written as it is (with the unused prefix before it in a layer),
+ * only the keys that resolve differently are assigned.
+ */
+void write_resolutions(ostream &out, const State &state, size_t slots) {
+    out << "        constexpr std::array<ResolutionTable, SLOTS> resolutions() {\n";
+    out << "            std::array<ResolutionTable, SLOTS> tables{};\n";
+    out << "            for (int slot = 0; slot < SLOTS; slot++) {\n";
+    out << "                for (int code = 0; code < KEY_CNT; code++) {\n";
+    out << "                    tables[slot][code] = pass_through(code, slot > 0 ? Resolution::TAP_PREFIX : 0);\n";
+    out << "                }\n";
+    out << "            }\n";
+    for (size_t slot = 0; slot < slots; slot++) {
+        out << "            // " << (slot > 0 ? "layer " + serialize_key(state.layers.by_position(slot - 1).code)
+                                             : "no layer") << "\n";
+        for (int code = 0; code < KEY_CNT; code++) {
+            const auto &resolution = state.resolved[slot][code];
+            if (same(resolution, pass_through(code, slot > 0 ? Resolution::TAP_PREFIX : 0))) {
+                continue;
+            }
+            out << "            tables[" << slot << "][" << code << "] = ";
+            if (resolution.flags & Resolution::GENERAL) {
+                out << "Resolution{}; // " << serialize_key(code) << ", the general path\n";
+            } else {
+                out << literal(resolution) << "; // " << serialize_key(code) << "\n";
+            }
+        }
+    }
+    out << "            return tables;\n";
+    out << "        }\n\n";
+    out << "        inline constexpr std::array<ResolutionTable, SLOTS> RESOLUTIONS = resolutions();\n\n";
+    out << "        /**\n";
+    out << "         * the fast path for the stacks in the first SLOTS slots, for a key event with value 0 to 2.\n";
+    out << "         * false if the event has to take the tables built at runtime or the general path.\n";
+    out << "         */\n";
+    out << "        template<typename Log>\n";
+    out << "        inline bool apply(State &state, const input_event &event, OutputSpan &out, Log &log) {\n";
+    out << "            if (state.slot < 0 || state.slot >= SLOTS) {\n";
+    out << "                return false;\n";
+    out << "            }\n";
+    out << "            const auto &resolution = RESOLUTIONS[state.slot][event.code];\n";
+    out << "            if (resolution.flags & Resolution::GENERAL) {\n";
+    out << "                return false;\n";
+    out << "            }\n";
+    out << "            apply_resolution(state, resolution, event, out, log);\n";
+    out << "            return true;\n";
+    out << "        }\n";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    string config_file = argv[1];
+    Config config = read_config(config_file);
+    auto state = build_state(config);
+    auto slots = state.layers.size() + 1;
+
+    ostringstream out;
+    out << "// generated by schoenberg_gen from " << config_file << ", do not edit\n";
+    out << "#pragma once\n\n";
+    out << "#include \"schoenberg.h\"\n\n";
+    out << "namespace schoenberg {\n\n";
+    out << "    namespace generated {\n\n";
+    out << "        constexpr const char *SOURCE = " << quoted(config_file) << ";\n\n";
+    out << "        // the slots of State::resolved apply covers: the empty stack and every layer on its own\n";
+    out << "        constexpr int SLOTS = " << slots << ";\n\n";
+    out << "        // the keymap, the engine has to be built from it for the slots to match\n";
+    write_config(out, config);
+    out << "\n";
+    out << "        // State::resolved of the first SLOTS slots, for an engine built from config(). constant data for the\n";
+    out << "        // same apply_resolution the tables built at startup go through, no code is specialized per key\n";
+    write_resolutions(out, state, slots);
+    out << "\n";
+    out << "    }\n\n";
+    out << "}\n";
+
+    ofstream file(argv[2]);
+    file << out.str();
+    if (!file.flush()) {
+        cerr << "can not write " << argv[2] << endl;
+        return 1;
+    }
+    return 0;
+}
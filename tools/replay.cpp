@@ -0,0 +1,194 @@
+#include "schoenberg.h"
+#include "cache.h"
+#include "io.h"
+#include "pipeline.h"
+#include "record.h"
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+using namespace schoenberg;
+
+void usage(const char *name) {
+    cerr << "usage: " << name << " [--timing] [--repeat N] CONFIG TRACE" << endl;
+    cerr << "feeds the input of a trace recorded with schoenberg_run --record through the engine and compares" << endl;
+    cerr << "the output with the recorded one. exits with 1 if they differ." << endl;
+    cerr << "  --timing      feed the events with their original timing instead of as fast as possible" << endl;
+    cerr << "  --repeat N    replay N times and report the fastest run" << endl;
+}
+
+uint64_t elapsed_ns(const input_event &from, const input_event &to) {
+    return (int64_t(to.time.tv_sec) - from.time.tv_sec) * 1000000000 +
+           (int64_t(to.time.tv_usec) - from.time.tv_usec) * 1000;
+}
+
+bool same(const input_event &a, const input_event &b) {
+    return a.type == b.type && a.code == b.code && a.value == b.value;
+}
+
+string describe(const input_event &event) {
+    if (event.type == EV_KEY) {
+        return "key " + serialize_key(event.code) + " " + to_string(event.value);
+    }
+    return "type " + to_string(event.type) + " code " + to_string(event.code) + " value " + to_string(event.value);
+}
+
+void write_all(int fd, const vector<input_event> &events) {
+    auto bytes = reinterpret_cast<const char *>(events.data());
+    size_t length = events.size() * sizeof(input_event);
+    while (length > 0) {
+        auto res = write(fd, bytes, length);
+        if (res < 0) {
+            throw runtime_error("can not write the input");
+        }
+        bytes += res;
+        length -= res;
+    }
+}
+
+uint64_t time_ns(const input_event &event) {
+    return uint64_t(event.time.tv_sec) * 1000000000 + uint64_t(event.time.tv_usec) * 1000;
+}
+
+/**
+ * the production event loop on a file instead of stdin/stdout, returns the written events. the deadlines of the
+ * engine run on the clock of the recording: they expire before the first input after them, the ones after the
+ * last input up to end (the last recorded event).
+ */
+vector<input_event> replay(const Config &config, const vector<input_event> &inputs, uint64_t end, bool timing,
+                           uint64_t &ns) {
+    int in;
+    std::thread feeder;
+    if (timing) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            throw runtime_error("pipe failed");
+        }
+        in = fds[0];
+        feeder = std::thread([&inputs, fd = fds[1]]() {
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < inputs.size(); i++) {
+                if (i > 0) {
+                    this_thread::sleep_until(start + chrono::nanoseconds(elapsed_ns(inputs[0], inputs[i])));
+                }
+                if (write(fd, &inputs[i], sizeof(input_event)) != sizeof(input_event)) {
+                    break;
+                }
+            }
+            close(fd);
+        });
+    } else {
+        in = memfd_create("schoenberg-replay-in", 0);
+        write_all(in, inputs);
+        lseek(in, 0, SEEK_SET);
+    }
+    auto out = memfd_create("schoenberg-replay-out", 0);
+
+    Engine engine(config);
+    EventReader reader(in);
+    EventWriter writer(out);
+    OutputBuffer<> output;
+    auto start = chrono::steady_clock::now();
+    while (reader.fill()) {
+        forward_recorded(engine, reader, output, writer, NoLog());
+        writer.flush();
+    }
+    forward_expired_until(engine, end + 1, output, writer, NoLog());
+    writer.flush();
+    ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    if (feeder.joinable()) {
+        feeder.join();
+    }
+    close(in);
+
+    vector<input_event> written(lseek(out, 0, SEEK_END) / sizeof(input_event));
+    if (pread(out, written.data(), written.size() * sizeof(input_event), 0) < 0) {
+        throw runtime_error("can not read the output back");
+    }
+    close(out);
+    return written;
+}
+
+int main(int argc, char *argv[]) {
+    static option options[] = {
+            {"timing", no_argument,       nullptr, 't'},
+            {"repeat", required_argument, nullptr, 'r'},
+            {"help",   no_argument,       nullptr, 'h'},
+            {nullptr, 0,                  nullptr, 0},
+    };
+    bool timing = false;
+    int repeat = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "tr:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 't':
+                timing = true;
+                break;
+            case 'r':
+                repeat = max(1, atoi(optarg));
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        auto config = load_config(argv[optind]);
+        Trace trace(argv[optind + 1]);
+        vector<input_event> inputs, recorded;
+        uint64_t end = 0;
+        for (const auto &record: trace) {
+            (record.direction == RecordedEvent::INPUT ? inputs : recorded).push_back(record.event);
+            end = max(end, time_ns(record.event));
+        }
+
+        vector<input_event> written;
+        uint64_t fastest = UINT64_MAX;
+        for (int i = 0; i < repeat; i++) {
+            uint64_t ns;
+            written = replay(config, inputs, end, timing, ns);
+            fastest = min(fastest, ns);
+        }
+
+        cout << inputs.size() << " input events, " << written.size() << " output events in " << fastest / 1000
+             << "us";
+        if (!timing && fastest > 0) {
+            cout << ", " << inputs.size() * 1e3 / fastest << " M events/s";
+        }
+        cout << endl;
+
+        size_t differences = 0;
+        for (size_t i = 0; i < max(written.size(), recorded.size()); i++) {
+            if (i < written.size() && i < recorded.size() && same(written[i], recorded[i])) {
+                continue;
+            }
+            if (differences++ < 10) {
+                cout << "output " << i << ": recorded "
+                     << (i < recorded.size() ? describe(recorded[i]) : string("nothing")) << ", replayed "
+                     << (i < written.size() ? describe(written[i]) : string("nothing")) << endl;
+            }
+        }
+        if (differences > 0) {
+            cout << differences << " output events differ" << endl;
+            return 1;
+        }
+        cout << "the output matches the recording" << endl;
+        return 0;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,101 @@
+#include "stats.h"
+#include <chrono>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace schoenberg;
+
+void usage(const char *name) {
+    cerr << "usage: " << name << " [--buckets] [--watch SECONDS] NAME" << endl;
+    cerr << "prints the latency histogram schoenberg_run --stats NAME keeps in shared memory" << endl;
+    cerr << "  --buckets          print every non empty bucket" << endl;
+    cerr << "  --watch SECONDS    print again every SECONDS" << endl;
+}
+
+string duration(uint64_t ns) {
+    stringstream out;
+    out << fixed << setprecision(1);
+    if (ns < 1000) {
+        out << ns << "ns";
+    } else if (ns < 1000000) {
+        out << ns / 1e3 << "us";
+    } else {
+        out << ns / 1e6 << "ms";
+    }
+    return out.str();
+}
+
+void print(const LatencyHistogram &histogram, bool buckets) {
+    auto count = histogram.count.load(memory_order_relaxed);
+    cout << "events " << count;
+    if (count > 0) {
+        cout << "  mean " << duration(histogram.sum.load(memory_order_relaxed) / count)
+             << "  p50 " << duration(histogram.percentile(0.5))
+             << "  p90 " << duration(histogram.percentile(0.9))
+             << "  p99 " << duration(histogram.percentile(0.99))
+             << "  p99.9 " << duration(histogram.percentile(0.999))
+             << "  max " << duration(histogram.max.load(memory_order_relaxed));
+    }
+    auto skewed = histogram.skewed.load(memory_order_relaxed);
+    if (skewed > 0) {
+        cout << "  timestamps in the future " << skewed;
+    }
+    cout << endl;
+    if (buckets) {
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            auto n = histogram.counts[i].load(memory_order_relaxed);
+            if (n > 0) {
+                cout << "  >= " << setw(8) << duration(LatencyHistogram::bucket_floor(i)) << "  " << n << endl;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static option options[] = {
+            {"buckets", no_argument,       nullptr, 'b'},
+            {"watch",   required_argument, nullptr, 'w'},
+            {"help",    no_argument,       nullptr, 'h'},
+            {nullptr, 0,                   nullptr, 0},
+    };
+    bool buckets = false;
+    int watch = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "bw:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'b':
+                buckets = true;
+                break;
+            case 'w':
+                watch = atoi(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    try {
+        auto segment = StatsSegment::open(argv[optind]);
+        while (true) {
+            print(*segment.histogram, buckets);
+            if (watch <= 0) {
+                return 0;
+            }
+            this_thread::sleep_for(chrono::seconds(watch));
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "schoenberg.h"
+#include "utils.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// counts every heap allocation of the test binary
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    if (auto p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+using namespace schoenberg;
+
+size_t run_events(Config &config, State &state, const vector<input_event> &events, OutputSpan &out) {
+    size_t written = 0;
+    for (const auto &e: events) {
+        out.clear();
+        written += schoenberg::process(config, state, e, out);
+    }
+    return written;
+}
+
+TEST(Allocation, steady_state_does_not_allocate) {
+    auto config = read_config("tst/test.yaml");
+    auto state = build_state(config);
+    vector<input_event> events;
+    auto add = [&](int value, const string &key) {
+        events.push_back(input_event{.type = EV_KEY, .code = (__u16) parse_key(key), .value = value});
+    };
+    // plain keys, global mapping, a layer with and without mod, an unused prefix and a repeat
+    for (auto key: {"A", "CAPSLOCK", "GRAVE"}) {
+        add(1, key);
+        add(2, key);
+        add(0, key);
+    }
+    for (auto key: {"H", "U", "G"}) {
+        add(1, "F");
+        add(2, "F");
+        add(1, key);
+        add(0, key);
+        add(0, "F");
+    }
+    add(1, "N");
+    add(0, "N");
+
+    OutputBuffer<> out;
+    auto warm_up = run_events(config, state, events, out);
+
+    auto before = allocations.load();
+    auto written = run_events(config, state, events, out);
+    auto after = allocations.load();
+
+    EXPECT_EQ(warm_up, written);
+    EXPECT_EQ(0, after - before);
+
+    // make sure the counter actually sees allocations
+    NulOStream logs;
+    auto legacy = process_mapping(config, events[0], logs);
+    EXPECT_LT(after, allocations.load());
+}
+
+TEST(Allocation, first_stack_of_layers_does_not_allocate) {
+    auto config = read_config("tst/stack.yaml");
+    auto state = build_state(config);
+    // D toggled on, F held on top of it: the stack of both is used for the first time, without a warm up
+    vector<input_event> events;
+    for (auto [code, value]: vector<pair<int, int>>{{KEY_D, 1}, {KEY_D, 0}, {KEY_F, 1}, {KEY_J, 1}, {KEY_J, 0},
+                                                     {KEY_F, 0}}) {
+        events.push_back(input_event{.type = EV_KEY, .code = (__u16) code, .value = value});
+    }
+
+    OutputBuffer<> out;
+    auto before = allocations.load();
+    run_events(config, state, events, out);
+    EXPECT_EQ(0, allocations.load() - before);
+}
@@ -0,0 +1,171 @@
+#include "test_utils.h"
+
+using namespace schoenberg;
+
+namespace {
+
+    input_event event_of(int type, int code, int value) {
+        return input_event{.type = (__u16) type, .code = (__u16) code, .value = value};
+    }
+
+    input_event key(int code, int value) {
+        return event_of(EV_KEY, code, value);
+    }
+
+    input_event scan(int code) {
+        return event_of(EV_MSC, MSC_SCAN, code);
+    }
+
+    input_event syn() {
+        return event_of(EV_SYN, SYN_REPORT, 0);
+    }
+
+    // (type, code, value) with a -1 where the engine ended a frame
+    vector<std::tuple<int, int, int>> flat(const OutputSpan &out) {
+        vector<std::tuple<int, int, int>> res;
+        for (size_t i = 0; i < out.size(); i++) {
+            res.emplace_back(out[i].type, out[i].code, out[i].value);
+            if (out.frame_end(i)) {
+                res.emplace_back(-1, -1, -1);
+            }
+        }
+        return res;
+    }
+
+    // a typing session as the kernel sends it, with mouse motion in between
+    vector<input_event> session(size_t frames) {
+        const int keys[] = {KEY_F, KEY_N, KEY_H, KEY_J, KEY_U, KEY_I, KEY_S, KEY_A, KEY_G, KEY_CAPSLOCK};
+        vector<input_event> events;
+        vector<int> down;
+        uint32_t seed = 3;
+        for (size_t i = 0; i < frames; i++) {
+            seed = seed * 1664525 + 1013904223;
+            if ((seed >> 24) % 5 == 0) {
+                events.push_back(event_of(EV_REL, REL_X, 1));
+                events.push_back(event_of(EV_REL, REL_Y, -1));
+            } else if (!down.empty() && ((seed >> 8) % 2 || down.size() >= 3)) {
+                auto code = down[(seed >> 12) % down.size()];
+                down.erase(std::find(down.begin(), down.end(), code));
+                events.push_back(scan(code));
+                events.push_back(key(code, 0));
+            } else {
+                auto code = keys[(seed >> 12) % (sizeof(keys) / sizeof(keys[0]))];
+                if (std::find(down.begin(), down.end(), code) == down.end()) {
+                    down.push_back(code);
+                    events.push_back(scan(code));
+                    events.push_back(key(code, 1));
+                }
+            }
+            events.push_back(syn());
+        }
+        return events;
+    }
+
+}
+
+TEST(Batch, classify_matches_scalar) {
+    auto events = session(200);
+    events.push_back(event_of(EV_MSC, MSC_TIMESTAMP, 5));
+    events.push_back(event_of(EV_SYN, SYN_DROPPED, 0));
+    for (size_t start = 0; start + 64 <= events.size(); start += 7) {
+        for (size_t count: {size_t(0), size_t(1), size_t(7), size_t(8), size_t(13), size_t(64)}) {
+            uint64_t keys, scans, syns, scalar_keys, scalar_scans, scalar_syns;
+            classify(events.data() + start, count, keys, scans, syns);
+            classify_scalar(events.data() + start, count, scalar_keys, scalar_scans, scalar_syns);
+            ASSERT_EQ(scalar_keys, keys) << start << " " << count;
+            ASSERT_EQ(scalar_scans, scans) << start << " " << count;
+            ASSERT_EQ(scalar_syns, syns) << start << " " << count;
+        }
+    }
+
+    uint64_t keys, scans, syns;
+    vector<input_event> frame = {scan(30), key(KEY_A, 1), syn(), event_of(EV_SYN, SYN_DROPPED, 0)};
+    classify(frame.data(), frame.size(), keys, scans, syns);
+    EXPECT_EQ(0b0010, keys);
+    EXPECT_EQ(0b0001, scans);
+    EXPECT_EQ(0b0100, syns);
+}
+
+TEST(Batch, forwards_like_single_events) {
+    auto config = test_config();
+    auto state = build_state(config);
+    vector<input_event> events = {
+            event_of(EV_REL, REL_X, 3), event_of(EV_REL, REL_Y, -2), syn(),
+            // the prefix press produces nothing, its frame is dropped
+            scan(33), key(KEY_F, 1), syn(),
+            scan(22), key(KEY_U, 1), syn(),
+            key(KEY_U, 0), syn(),
+            key(KEY_F, 0), syn(),
+            scan(58), key(KEY_CAPSLOCK, 1), syn(),
+    };
+    events[7].time = {7, 0};
+    OutputBuffer<BATCH_OUTPUT_EVENTS> out;
+    BatchFrame frame;
+    EXPECT_EQ(events.size(), process_batch(config, state, events.data(), events.size(), out, frame));
+    EXPECT_EQ((vector<std::tuple<int, int, int>>{
+            {EV_REL, REL_X, 3}, {EV_REL, REL_Y, -2}, {EV_SYN, SYN_REPORT, 0},
+            {EV_KEY, KEY_LEFTSHIFT, 1}, {-1, -1, -1}, {EV_KEY, KEY_LEFTBRACE, 1}, {EV_SYN, SYN_REPORT, 0},
+            {EV_KEY, KEY_LEFTBRACE, 0}, {-1, -1, -1}, {EV_KEY, KEY_LEFTSHIFT, 0}, {EV_SYN, SYN_REPORT, 0},
+            {EV_KEY, KEY_ESC, 1}, {EV_SYN, SYN_REPORT, 0},
+    }), flat(out));
+    // the output of a key has its timestamp
+    EXPECT_EQ(7, out[3].time.tv_sec);
+    EXPECT_EQ(7, out[4].time.tv_sec);
+}
+
+TEST(Batch, stops_when_the_output_is_full_and_goes_on) {
+    auto config = test_config();
+    auto events = session(3000);
+
+    auto whole_state = build_state(config);
+    OutputBuffer<4 * BATCH_OUTPUT_EVENTS> whole;
+    BatchFrame whole_frame;
+    ASSERT_EQ(events.size(), process_batch(config, whole_state, events.data(), events.size(), whole, whole_frame));
+
+    // a small output and the input in odd pieces
+    auto state = build_state(config);
+    OutputBuffer<MAX_OUTPUT_EVENTS + 5> out;
+    BatchFrame frame;
+    vector<std::tuple<int, int, int>> pieces;
+    size_t taken = 0, calls = 0;
+    while (taken < events.size()) {
+        auto count = std::min(events.size() - taken, size_t(37));
+        out.clear();
+        taken += process_batch(config, state, events.data() + taken, count, out, frame);
+        auto part = flat(out);
+        pieces.insert(pieces.end(), part.begin(), part.end());
+        calls++;
+    }
+    EXPECT_GT(calls, events.size() / 37);
+    EXPECT_EQ(flat(whole), pieces);
+    EXPECT_EQ(whole_state.key_state.count(), state.key_state.count());
+}
+
+TEST(Batch, matches_process) {
+    auto config = test_config();
+    auto events = session(2000);
+
+    auto batch_state = build_state(config);
+    OutputBuffer<4 * BATCH_OUTPUT_EVENTS> batch;
+    BatchFrame frame;
+    process_batch(config, batch_state, events.data(), events.size(), batch, frame);
+
+    // only the keys, one at a time
+    auto state = build_state(config);
+    OutputBuffer<4 * BATCH_OUTPUT_EVENTS> single;
+    for (const auto &e: events) {
+        if (e.type == EV_KEY) {
+            process(config, state, e, single);
+        }
+    }
+    vector<pair<int, int>> expected, actual;
+    for (const auto &e: single) {
+        expected.emplace_back(e.code, e.value);
+    }
+    for (const auto &e: batch) {
+        if (e.type == EV_KEY) {
+            actual.emplace_back(e.code, e.value);
+        }
+    }
+    EXPECT_EQ(expected, actual);
+}
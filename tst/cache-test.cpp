@@ -0,0 +1,120 @@
+#include "gtest/gtest.h"
+#include "cache.h"
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+// a copy of a config in a directory of its own, removed with its cache after the test
+class ConfigCopy {
+public:
+    explicit ConfigCopy(const string &from) {
+        char dir[] = "/tmp/schoenberg-cache-XXXXXX";
+        EXPECT_NE(nullptr, mkdtemp(dir));
+        this->dir = dir;
+        file = this->dir + "/config.yaml";
+        std::ifstream in(from);
+        std::ofstream(file) << in.rdbuf();
+    }
+
+    ~ConfigCopy() {
+        unlink(cache_file(file).c_str());
+        unlink(file.c_str());
+        rmdir(dir.c_str());
+    }
+
+    string dir;
+    string file;
+};
+
+TEST(Cache, round_trip) {
+    ConfigCopy copy("tst/test.yaml");
+    auto &file = copy.file;
+    EXPECT_FALSE(read_cache(file).has_value());
+
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+
+    auto config = read_config(file);
+    ASSERT_EQ(config.layers.size(), cached->layers.size());
+    for (size_t i = 0; i < config.layers.size(); i++) {
+        EXPECT_EQ(config.layers[i].prefix, cached->layers[i].prefix);
+        for (int code = 0; code < KEY_CNT; code++) {
+            EXPECT_EQ(config.layers[i].keys.lookup(code).key, cached->layers[i].keys.lookup(code).key);
+            EXPECT_EQ(config.layers[i].keys.lookup(code).mod, cached->layers[i].keys.lookup(code).mod);
+        }
+    }
+    for (int code = 0; code < KEY_CNT; code++) {
+        EXPECT_EQ(config.keys.lookup(code).key, cached->keys.lookup(code).key);
+    }
+}
+
+TEST(Cache, stale_after_change) {
+    ConfigCopy copy("tst/test.yaml");
+    auto &file = copy.file;
+    write_cache(file);
+    std::ofstream(file, std::ios::app) << "\n";
+    EXPECT_FALSE(read_cache(file).has_value());
+
+    // the yaml is used instead
+    auto config = load_config(file);
+    EXPECT_EQ(2, config.layers.size());
+}
+
+TEST(Cache, keeps_the_tapping_term) {
+    ConfigCopy copy("tst/taphold.yaml");
+    auto &file = copy.file;
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(180, cached->tapping_term);
+    EXPECT_TRUE(cached->permissive_hold);
+}
+
+TEST(Cache, keeps_the_combos) {
+    ConfigCopy copy("tst/combo.yaml");
+    auto &file = copy.file;
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(40, cached->combo_term);
+    ASSERT_EQ(4, cached->combos.size());
+    EXPECT_EQ(vector<int>({KEY_S, KEY_D, KEY_F}), cached->combos[3].keys);
+    EXPECT_EQ(KEY_LEFTSHIFT, cached->combos[1].target.mod);
+    EXPECT_EQ(read_config(file).machine.next, cached->machine.next);
+}
+
+TEST(Cache, keeps_toggle_layers) {
+    ConfigCopy copy("tst/stack.yaml");
+    auto &file = copy.file;
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_FALSE(cached->layers[0].toggle);
+    EXPECT_TRUE(cached->layers[1].toggle);
+}
+
+TEST(Cache, keeps_the_repeat_rate) {
+    ConfigCopy copy("tst/repeat.yaml");
+    auto &file = copy.file;
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(25, cached->repeat_rate);
+    EXPECT_EQ(200, cached->repeat_delay);
+}
+
+TEST(Cache, writes_repeated_combo_keys_once) {
+    ConfigCopy copy("tst/combo.yaml");
+    auto &file = copy.file;
+    // more entries than a combo has keys, the same key twice is the key once
+    std::ofstream(file) << "combos:\n  - keys: [J, K, J, K, J, K, J, K, J, K]\n    key: ESC\n";
+    write_cache(file);
+    auto cached = read_cache(file);
+    ASSERT_TRUE(cached.has_value());
+    ASSERT_EQ(1, cached->combos.size());
+    EXPECT_EQ(vector<int>({KEY_J, KEY_K}), cached->combos[0].keys);
+    EXPECT_EQ(read_config(file).machine.next, cached->machine.next);
+}
@@ -0,0 +1,145 @@
+#include "test_utils.h"
+#include "cache.h"
+
+using namespace schoenberg;
+
+namespace {
+
+    class Combo : public EngineTest {
+    protected:
+        Combo() : EngineTest(read_config("tst/combo.yaml")) {}
+    };
+
+}
+
+TEST_F(Combo, fires_as_soon_as_complete) {
+    EXPECT_EQ(Events(), run(key_at(0, KEY_J, 1)));
+    EXPECT_EQ(time_at(40), next_deadline(state));
+    EXPECT_EQ(Events({{KEY_ESC, 1}}), run(key_at(10, KEY_K, 1)));
+    EXPECT_EQ(0, next_deadline(state));
+    EXPECT_FALSE(state.combo.active());
+
+    EXPECT_EQ(Events({{KEY_ESC, 2}}), run(key_at(300, KEY_K, 2)));
+    // the first release releases the target, the second is swallowed
+    EXPECT_EQ(Events({{KEY_ESC, 0}}), run(key_at(400, KEY_J, 0)));
+    EXPECT_EQ(Events(), run(key_at(410, KEY_K, 0)));
+    EXPECT_FALSE(state.key_state.any());
+    EXPECT_EQ(0, state.combo.consumed_count);
+}
+
+TEST_F(Combo, order_does_not_matter) {
+    run(key_at(0, KEY_K, 1));
+    EXPECT_EQ(Events({{KEY_ESC, 1}}), run(key_at(10, KEY_J, 1)));
+}
+
+TEST_F(Combo, target_with_mod) {
+    run(key_at(0, KEY_F, 1));
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_9, 1}}), run(key_at(10, KEY_G, 1)));
+    EXPECT_TRUE(out.frame_end(0));
+    EXPECT_EQ(Events({{KEY_9, 0}, {KEY_LEFTSHIFT, 0}}), run(key_at(100, KEY_F, 0)));
+    EXPECT_TRUE(out.frame_end(0));
+    // F was swallowed, it did not activate its layer
+    EXPECT_EQ(nullptr, state.active());
+    EXPECT_EQ(Events(), run(key_at(110, KEY_G, 0)));
+}
+
+TEST_F(Combo, single_key_is_written_at_the_deadline) {
+    run(key_at(0, KEY_J, 1));
+    EXPECT_EQ(Events(), expire_at(39));
+    EXPECT_EQ(Events({{KEY_J, 1}}), expire_at(40));
+    EXPECT_EQ(0, next_deadline(state));
+    EXPECT_EQ(Events({{KEY_J, 0}}), run(key_at(100, KEY_J, 0)));
+}
+
+TEST_F(Combo, release_before_the_deadline_is_a_tap) {
+    run(key_at(0, KEY_J, 1));
+    EXPECT_EQ(Events({{KEY_J, 1}, {KEY_J, 0}}), run(key_at(20, KEY_J, 0)));
+}
+
+TEST_F(Combo, late_key_is_no_combo) {
+    run(key_at(0, KEY_J, 1));
+    EXPECT_EQ(Events({{KEY_J, 1}}), run(key_at(60, KEY_K, 1)));
+    // K starts a combo of its own
+    EXPECT_TRUE(state.combo.active());
+    EXPECT_EQ(Events({{KEY_K, 1}}), expire_at(100));
+}
+
+TEST_F(Combo, other_key_lets_the_pressed_keys_through) {
+    run(key_at(0, KEY_J, 1));
+    EXPECT_EQ(Events({{KEY_J, 1}, {KEY_A, 1}}), run(key_at(10, KEY_A, 1)));
+    // keys of different combos
+    run(key_at(20, KEY_K, 1));
+    EXPECT_EQ(Events({{KEY_K, 1}}), run(key_at(30, KEY_S, 1)));
+    EXPECT_TRUE(state.combo.active());
+}
+
+TEST_F(Combo, longer_combo_waits_for_its_last_key) {
+    run(key_at(0, KEY_S, 1));
+    // S + D is a combo, but S + D + F may still follow
+    EXPECT_EQ(Events(), run(key_at(5, KEY_D, 1)));
+    EXPECT_EQ(Events({{KEY_ENTER, 1}}), run(key_at(10, KEY_F, 1)));
+
+    for (auto key: {KEY_S, KEY_D, KEY_F}) {
+        run(key_at(100, key, 0));
+    }
+    run(key_at(200, KEY_S, 1));
+    run(key_at(205, KEY_D, 1));
+    EXPECT_EQ(Events({{KEY_TAB, 1}}), expire_at(240));
+    EXPECT_EQ(Events({{KEY_TAB, 0}}), run(key_at(300, KEY_D, 0)));
+}
+
+TEST_F(Combo, completed_combo_fires_on_release) {
+    run(key_at(0, KEY_S, 1));
+    run(key_at(5, KEY_D, 1));
+    EXPECT_EQ(Events({{KEY_TAB, 1}, {KEY_TAB, 0}}), run(key_at(20, KEY_S, 0)));
+    EXPECT_EQ(Events(), run(key_at(30, KEY_D, 0)));
+}
+
+TEST_F(Combo, repeats_while_undecided_are_dropped) {
+    run(key_at(0, KEY_J, 1));
+    EXPECT_EQ(Events(), run(key_at(30, KEY_J, 2)));
+    EXPECT_EQ(Events({{KEY_J, 1}}), expire_at(40));
+}
+
+TEST_F(Combo, keys_that_are_let_through_reach_the_layers) {
+    // F alone is the layer prefix
+    run(key_at(0, KEY_F, 1));
+    expire_at(40);
+    EXPECT_TRUE(state.active() != nullptr);
+    // inside the layer J and K are arrows, not a combo
+    EXPECT_EQ(Events({{KEY_DOWN, 1}}), run(key_at(50, KEY_J, 1)));
+    EXPECT_EQ(Events({{KEY_UP, 1}}), run(key_at(55, KEY_K, 1)));
+}
+
+TEST_F(Combo, keys_outside_combos_take_no_detour) {
+    EXPECT_EQ(Events({{KEY_ESC, 1}}), run(key_at(0, KEY_CAPSLOCK, 1)));
+    EXPECT_FALSE(state.combo.active());
+    EXPECT_EQ(0, next_deadline(state));
+}
+
+TEST(ComboConfig, compiled) {
+    auto config = read_config("tst/combo.yaml");
+    EXPECT_EQ(40, config.combo_term);
+    EXPECT_EQ(4, config.combos.size());
+    auto &machine = config.machine;
+    // J, K, F, G, S, D
+    EXPECT_EQ(6, machine.columns);
+    EXPECT_EQ(-1, machine.column_of(KEY_A));
+
+    // the same node in any order
+    auto jk = machine.step(machine.step(0, machine.column_of(KEY_J)), machine.column_of(KEY_K));
+    auto kj = machine.step(machine.step(0, machine.column_of(KEY_K)), machine.column_of(KEY_J));
+    EXPECT_EQ(jk, kj);
+    EXPECT_EQ(KEY_ESC, machine.targets[jk].key);
+    EXPECT_FALSE(machine.extends[jk]);
+    EXPECT_EQ(0, machine.step(machine.step(0, machine.column_of(KEY_J)), machine.column_of(KEY_S)));
+
+    EXPECT_EQ(40 * MS, build_state(config).combo_term);
+    EXPECT_EQ(0, build_state(read_config("tst/test.yaml")).combo_term);
+}
+
+TEST(ComboConfig, invalid) {
+    EXPECT_THROW(compile_combos({ComboConfig({KEY_J}, KeyTarget(KEY_ESC, -1))}), std::invalid_argument);
+    EXPECT_THROW(compile_combos({ComboConfig({KEY_J, KEY_K}, KeyTarget(KEY_ESC, -1)),
+                                 ComboConfig({KEY_K, KEY_J}, KeyTarget(KEY_TAB, -1))}), std::invalid_argument);
+}
@@ -19,3 +19,21 @@ TEST(Config, serialize) {
     EXPECT_EQ(target, res);
 }
 
+
+TEST(Config, unknownKey) {
+    EXPECT_THROW(schoenberg::read_config("./tst/invalid.yaml"), std::invalid_argument);
+}
+
+TEST(Config, layerIndex) {
+    auto config = schoenberg::read_config("./tst/test.yaml");
+    auto state = schoenberg::build_state(config);
+    EXPECT_TRUE(state.layers.count(schoenberg::parse_key("F")));
+    EXPECT_TRUE(state.layers.count(schoenberg::parse_key("N")));
+    EXPECT_FALSE(state.layers.count(schoenberg::parse_key("J")));
+    EXPECT_FALSE(state.layers.count(-1));
+    EXPECT_THROW(state.layers.at(schoenberg::parse_key("J")), std::out_of_range);
+
+    auto &layer = state.layers.at(schoenberg::parse_key("F"));
+    EXPECT_EQ(schoenberg::parse_key("LEFT"), layer.keys.lookup(schoenberg::parse_key("H")).key);
+    EXPECT_FALSE(layer.keys.count(schoenberg::parse_key("G")));
+}
@@ -0,0 +1,134 @@
+#include "test_utils.h"
+#include <set>
+
+using namespace schoenberg;
+
+namespace {
+
+    vector<tuple<int, int, bool>> written(const OutputSpan &events) {
+        vector<tuple<int, int, bool>> res;
+        for (size_t i = 0; i < events.size(); i++) {
+            res.emplace_back(events[i].code, events[i].value, events.frame_end(i));
+        }
+        return res;
+    }
+
+    vector<int> down(const State &state) {
+        vector<int> res;
+        state.key_state.for_each([&](int code) { res.push_back(code); });
+        return res;
+    }
+
+}
+
+TEST(Gen, config_matches_the_source) {
+    auto expected = read_config(generated::SOURCE);
+    auto actual = generated::config();
+    ASSERT_EQ(expected.layers.size(), actual.layers.size());
+    for (size_t i = 0; i < expected.layers.size(); i++) {
+        EXPECT_EQ(expected.layers[i].prefix, actual.layers[i].prefix);
+        EXPECT_EQ(expected.layers[i].toggle, actual.layers[i].toggle);
+        for (int code = 0; code < KEY_CNT; code++) {
+            EXPECT_EQ(expected.layers[i].keys.lookup(code).key, actual.layers[i].keys.lookup(code).key);
+            EXPECT_EQ(expected.layers[i].keys.lookup(code).mod, actual.layers[i].keys.lookup(code).mod);
+        }
+    }
+    for (int code = 0; code < KEY_CNT; code++) {
+        EXPECT_EQ(expected.keys.lookup(code).key, actual.keys.lookup(code).key);
+        EXPECT_EQ(expected.keys.lookup(code).mod, actual.keys.lookup(code).mod);
+    }
+    EXPECT_EQ(expected.tapping_term, actual.tapping_term);
+    EXPECT_EQ(expected.permissive_hold, actual.permissive_hold);
+    EXPECT_EQ(expected.combo_term, actual.combo_term);
+    EXPECT_EQ(expected.repeat_rate, actual.repeat_rate);
+    EXPECT_EQ(expected.repeat_delay, actual.repeat_delay);
+    EXPECT_EQ(expected.combos.size(), actual.combos.size());
+    // only the engine of the keymap reads the compiled tables, not one read from a file (a --profile)
+    EXPECT_TRUE(actual.compiled);
+    EXPECT_FALSE(expected.compiled);
+    EXPECT_EQ(generated::SLOTS, int(actual.layers.size() + 1));
+}
+
+// every key and value in every compiled slot, with the layer used and unused
+TEST(Gen, apply_matches_the_tables) {
+    auto config = generated::config();
+    auto initial = build_state(config);
+    NoLog log;
+    for (int slot = 0; slot < generated::SLOTS; slot++) {
+        for (int code = 0; code < KEY_CNT; code++) {
+            for (int value = 0; value <= 2; value++) {
+                for (auto used: {false, true}) {
+                    State table(initial.layers);
+                    if (slot > 0) {
+                        auto &layer = table.layers.by_position(slot - 1);
+                        layer.active = layer.held = true;
+                        layer.used = used;
+                        table.active_layer = slot - 1;
+                        table.stack = uint64_t(1) << (slot - 1);
+                    }
+                    table.slot = slot;
+                    table.slot_stack = table.stack;
+                    State compiled(table.layers);
+                    compiled.active_layer = table.active_layer;
+                    compiled.stack = table.stack;
+                    compiled.slot = table.slot;
+                    compiled.slot_stack = table.slot_stack;
+                    auto event = input_event{.type = EV_KEY, .code = (__u16) code, .value = value};
+
+                    OutputBuffer<> expected;
+                    const auto &resolution = initial.resolved[slot][code];
+                    auto general = resolution.flags & Resolution::GENERAL;
+                    if (!general) {
+                        apply_resolution(table, resolution, event, expected, log);
+                    }
+                    OutputBuffer<> actual;
+                    ASSERT_EQ(!general, generated::apply(compiled, event, actual, log)) << slot << " " << code;
+                    ASSERT_EQ(written(expected), written(actual)) << slot << " " << code << " " << value;
+                    ASSERT_EQ(down(table), down(compiled)) << slot << " " << code << " " << value;
+                    if (slot > 0) {
+                        const auto &layer = table.layers.by_position(slot - 1);
+                        const auto &other = compiled.layers.by_position(slot - 1);
+                        ASSERT_EQ(layer.used, other.used) << slot << " " << code << " " << value;
+                        ASSERT_EQ(layer.written, other.written) << slot << " " << code << " " << value;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// this test target has test.yaml compiled in, process takes the compiled path for the engine of generated::config()
+TEST(Gen, matches_the_interpreted_engine) {
+    Engine interpreted(read_config(generated::SOURCE));
+    Engine compiled(generated::config());
+    ASSERT_TRUE(compiled.config.compiled);
+    const char *keys[] = {"F", "N", "H", "J", "U", "I", "S", "A", "G", "CAPSLOCK", "GRAVE", "EQUAL", "ESC",
+                          "LEFTSHIFT"};
+
+    uint32_t seed = 11;
+    std::set<int> held;
+    for (int i = 0; i < 20000; i++) {
+        seed = seed * 1664525 + 1013904223;
+        auto code = parse_key(keys[(seed >> 8) % (sizeof(keys) / sizeof(keys[0]))]);
+        if (held.size() >= 3 || (!held.empty() && (seed >> 16) % 2)) {
+            code = *std::next(held.begin(), (seed >> 4) % held.size());
+        }
+        auto value = !held.count(code) ? 1 : ((seed >> 20) % 4 ? 0 : 2);
+        if (value == 1) {
+            held.insert(code);
+        } else if (value == 0) {
+            held.erase(code);
+        }
+        auto event = input_event{.type = EV_KEY, .code = (__u16) code, .value = (int) value};
+
+        OutputBuffer<> expected;
+        process(interpreted.config, interpreted.state, event, expected);
+        OutputBuffer<> actual;
+        process(compiled.config, compiled.state, event, actual);
+
+        ASSERT_EQ(written(expected), written(actual)) << "event " << i;
+        ASSERT_EQ(down(interpreted.state), down(compiled.state)) << "event " << i;
+        ASSERT_EQ(interpreted.state.active_layer, compiled.state.active_layer) << "event " << i;
+        ASSERT_EQ(interpreted.state.stack, compiled.state.stack) << "event " << i;
+    }
+}
@@ -0,0 +1,262 @@
+#include "gtest/gtest.h"
+#include "io.h"
+#include "pipeline.h"
+#include <vector>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+input_event key_event(__u16 code, int value) {
+    return input_event{.type = EV_KEY, .code = code, .value = value};
+}
+
+input_event event_of(__u16 type, __u16 code, int value) {
+    return input_event{.type = type, .code = code, .value = value};
+}
+
+input_event syn() {
+    return event_of(EV_SYN, SYN_REPORT, 0);
+}
+
+TEST(IO, ring_wraps_around) {
+    EventRing<4> ring;
+    input_event event;
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(ring.push(key_event(i, 1)));
+        EXPECT_TRUE(ring.push(key_event(i, 0)));
+        EXPECT_TRUE(ring.pop(event));
+        EXPECT_EQ(i, event.code);
+        EXPECT_EQ(1, event.value);
+        EXPECT_TRUE(ring.pop(event));
+        EXPECT_EQ(0, event.value);
+        EXPECT_FALSE(ring.pop(event));
+    }
+}
+
+TEST(IO, ring_full) {
+    EventRing<2> ring;
+    EXPECT_TRUE(ring.push(key_event(KEY_A, 1)));
+    EXPECT_TRUE(ring.push(key_event(KEY_A, 0)));
+    EXPECT_FALSE(ring.push(key_event(KEY_B, 1)));
+}
+
+TEST(IO, reader_handles_partial_events) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    auto event = key_event(KEY_A, 1);
+    auto bytes = reinterpret_cast<const char *>(&event);
+
+    EventReader reader(fds[0]);
+    input_event read_event;
+    ASSERT_EQ(10, write(fds[1], bytes, 10));
+    EXPECT_TRUE(reader.fill());
+    EXPECT_FALSE(reader.pop(read_event));
+
+    ASSERT_EQ(sizeof(event) - 10, write(fds[1], bytes + 10, sizeof(event) - 10));
+    EXPECT_TRUE(reader.fill());
+    EXPECT_TRUE(reader.pop(read_event));
+    EXPECT_EQ(KEY_A, read_event.code);
+
+    close(fds[1]);
+    EXPECT_FALSE(reader.fill());
+    close(fds[0]);
+}
+
+TEST(IO, writer_flushes_all_events) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    EventWriter writer(fds[1]);
+    // more than fits into the ring, so push has to flush in between
+    for (int i = 0; i < 300; i++) {
+        writer.push(key_event(i, 1));
+    }
+    EXPECT_TRUE(writer.flush());
+    close(fds[1]);
+
+    EventReader reader(fds[0]);
+    input_event event;
+    int count = 0;
+    while (reader.fill()) {
+        while (reader.pop(event)) {
+            EXPECT_EQ(count, event.code);
+            count++;
+        }
+    }
+    EXPECT_EQ(300, count);
+    close(fds[0]);
+}
+
+TEST(IO, writer_splits_runs_longer_than_the_ring) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    EventWriter writer(fds[1]);
+    std::vector<input_event> run;
+    for (int i = 0; i < 300; i++) {
+        run.push_back(key_event(i, 1));
+    }
+    writer.push(key_event(999, 1));
+    writer.push(reinterpret_cast<const char *>(run.data()), run.size() * sizeof(input_event));
+    EXPECT_TRUE(writer.flush());
+    close(fds[1]);
+
+    EventReader reader(fds[0]);
+    input_event event;
+    std::vector<int> codes;
+    while (reader.fill()) {
+        while (reader.pop(event)) {
+            codes.push_back(event.code);
+        }
+    }
+    ASSERT_EQ(301u, codes.size());
+    EXPECT_EQ(999, codes[0]);
+    for (int i = 0; i < 300; i++) {
+        EXPECT_EQ(i, codes[i + 1]);
+    }
+    close(fds[0]);
+}
+
+TEST(IO, ring_frames) {
+    EventRing<8> ring;
+    bool keys;
+    EXPECT_EQ(0, ring.frame(keys));
+
+    ring.push(event_of(EV_REL, REL_X, 1));
+    ring.push(event_of(EV_REL, REL_Y, 1));
+    EXPECT_EQ(0, ring.frame(keys));
+    ring.push(syn());
+    EXPECT_EQ(3, ring.frame(keys));
+    EXPECT_FALSE(keys);
+
+    input_event event;
+    for (int i = 0; i < 3; i++) {
+        ring.pop(event);
+    }
+    ring.push(event_of(EV_MSC, MSC_SCAN, 4));
+    ring.push(syn());
+    EXPECT_EQ(2, ring.frame(keys));
+    EXPECT_TRUE(keys);
+
+    ring.pop(event);
+    ring.pop(event);
+    // wraps around the end of the buffer
+    ring.push(event_of(EV_REL, REL_X, 1));
+    ring.push(key_event(KEY_A, 1));
+    ring.push(syn());
+    EXPECT_EQ(3, ring.frame(keys));
+    EXPECT_TRUE(keys);
+}
+
+// writes events into a pipe, runs them through forward_ready and returns what was written
+std::vector<input_event> forward_all(Engine &engine, const std::vector<input_event> &events) {
+    int in[2], out[2];
+    EXPECT_EQ(0, pipe(in));
+    EXPECT_EQ(0, pipe(out));
+    EXPECT_EQ(events.size() * sizeof(input_event),
+              write(in[1], events.data(), events.size() * sizeof(input_event)));
+
+    EventReader reader(in[0]);
+    EventWriter writer(out[1]);
+    OutputBuffer<> output;
+    EXPECT_TRUE(reader.fill());
+    forward_ready(engine, reader, output, writer, NoLog());
+    EXPECT_TRUE(writer.flush());
+    close(out[1]);
+
+    EventReader result(out[0]);
+    std::vector<input_event> written;
+    input_event event;
+    while (result.fill()) {
+        while (result.pop(event)) {
+            written.push_back(event);
+        }
+    }
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    return written;
+}
+
+void expect_events(const std::vector<input_event> &expected, const std::vector<input_event> &written) {
+    ASSERT_EQ(expected.size(), written.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].type, written[i].type) << i;
+        EXPECT_EQ(expected[i].code, written[i].code) << i;
+        EXPECT_EQ(expected[i].value, written[i].value) << i;
+    }
+}
+
+TEST(IO, forward_passes_frames_without_keys) {
+    Engine engine(read_config("./tst/test.yaml"));
+    auto written = forward_all(engine, {
+            event_of(EV_REL, REL_X, 3), event_of(EV_REL, REL_Y, -2), syn(),
+            event_of(EV_MSC, MSC_SCAN, 7), key_event(KEY_CAPSLOCK, 1), syn(),
+            event_of(EV_REL, REL_X, 1), syn(),
+            key_event(KEY_CAPSLOCK, 0), syn(),
+            // no SYN_REPORT yet
+            event_of(EV_ABS, ABS_X, 100),
+    });
+    expect_events({
+                          event_of(EV_REL, REL_X, 3), event_of(EV_REL, REL_Y, -2), syn(),
+                          key_event(KEY_ESC, 1), syn(),
+                          event_of(EV_REL, REL_X, 1), syn(),
+                          key_event(KEY_ESC, 0), syn(),
+                          event_of(EV_ABS, ABS_X, 100),
+                  }, written);
+}
+
+TEST(IO, forward_splits_synthetic_frames) {
+    Engine engine(read_config("./tst/test.yaml"));
+    auto written = forward_all(engine, {
+            // the prefix press produces nothing, its frame is dropped
+            event_of(EV_MSC, MSC_SCAN, 33), key_event(KEY_F, 1), syn(),
+            key_event(KEY_U, 1), syn(),
+            key_event(KEY_U, 0), syn(),
+            key_event(KEY_F, 0), syn(),
+    });
+    expect_events({
+                          key_event(KEY_LEFTSHIFT, 1), syn(), key_event(KEY_LEFTBRACE, 1), syn(),
+                          key_event(KEY_LEFTBRACE, 0), syn(), key_event(KEY_LEFTSHIFT, 0), syn(),
+                  }, written);
+}
+
+TEST(IO, forward_batch_writes_output_longer_than_the_ring) {
+    auto config = read_config("./tst/taphold.yaml");
+    config.tapping_term = 500;
+    config.permissive_hold = false;
+    Engine engine(config);
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    EventWriter writer(fds[1]);
+    OutputBuffer<BATCH_OUTPUT_EVENTS> output;
+
+    // the taps are held back while the prefix is undecided
+    std::vector<input_event> first = {key_event(KEY_F, 1), syn()};
+    for (int i = 0; i < 10; i++) {
+        first.insert(first.end(), {key_event(KEY_A, 1), syn(), key_event(KEY_A, 0), syn()});
+    }
+    forward_batch(engine, first.data(), first.size(), output, writer, NoLog());
+    // the release of the prefix decides it and replays them, the motion frames follow in the same batch
+    std::vector<input_event> second = {key_event(KEY_F, 0), syn()};
+    for (int i = 0; i < 125; i++) {
+        second.insert(second.end(), {event_of(EV_REL, REL_X, 1), syn()});
+    }
+    forward_batch(engine, second.data(), second.size(), output, writer, NoLog());
+    EXPECT_TRUE(writer.flush());
+    close(fds[1]);
+
+    EventReader reader(fds[0]);
+    input_event event;
+    size_t motion = 0, keys = 0;
+    auto f_up = false;
+    while (reader.fill()) {
+        while (reader.pop(event)) {
+            motion += event.type == EV_REL;
+            keys += event.type == EV_KEY && event.code == KEY_A;
+            f_up |= event.type == EV_KEY && event.code == KEY_F && event.value == 0;
+        }
+    }
+    close(fds[0]);
+    EXPECT_EQ(125u, motion);
+    EXPECT_EQ(20u, keys);
+    EXPECT_TRUE(f_up);
+}
@@ -0,0 +1,42 @@
+#include "gtest/gtest.h"
+#include "schoenberg.h"
+#include "keycodes.h"
+
+using namespace schoenberg;
+
+static_assert(keycodes::find("ESC") == KEY_ESC);
+static_assert(keycodes::find("KEY_ESC") == -1);
+static_assert(keycodes::name(KEY_CAPSLOCK) == "CAPSLOCK");
+
+TEST(Keycodes, everyNameIsFound) {
+    for (const auto &key: keycodes::KEYS) {
+        EXPECT_EQ(key.code, parse_key(key.name)) << key.name;
+    }
+}
+
+TEST(Keycodes, canonicalNamesRoundTrip) {
+    for (const auto &key: keycodes::KEYS) {
+        if (key.canonical && key.code < KEY_CNT) {
+            EXPECT_EQ(key.code, parse_key(serialize_key(key.code))) << key.name;
+        }
+    }
+}
+
+TEST(Keycodes, aliases) {
+    // defined as another name in the header
+    EXPECT_EQ(KEY_MUTE, parse_key("MIN_INTERESTING"));
+    EXPECT_EQ(BTN_LEFT, parse_key("BTN_MOUSE"));
+    EXPECT_EQ("BTN_LEFT", serialize_key(BTN_LEFT));
+}
+
+TEST(Keycodes, unknown) {
+    EXPECT_EQ(-1, parse_key(""));
+    EXPECT_EQ(-1, parse_key("NOT_A_KEY"));
+    EXPECT_EQ(-1, parse_key("esc"));
+    EXPECT_EQ(-1, parse_key("LEFT "));
+
+    EXPECT_TRUE(key_name(-1).empty());
+    EXPECT_TRUE(key_name(KEY_CNT).empty());
+    EXPECT_EQ("UNKNOWN(-1)", serialize_key(-1));
+    EXPECT_EQ("UNKNOWN(" + std::to_string(KEY_CNT) + ")", serialize_key(KEY_CNT));
+}
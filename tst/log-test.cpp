@@ -0,0 +1,35 @@
+#include "gtest/gtest.h"
+#include "log.h"
+#include <type_traits>
+
+using namespace schoenberg;
+
+TEST(Log, no_log_is_empty) {
+    EXPECT_TRUE(std::is_empty<NoLog>::value);
+    EXPECT_FALSE(NoLog::enabled);
+}
+
+TEST(Log, trace_ring_keeps_order) {
+    TraceRing ring;
+    TraceLog log{&ring};
+    log(LogTag::INPUT, KEY_A, 1);
+    log(LogTag::MAPPED_KEY, KEY_B, 1);
+
+    TraceRecord record;
+    ASSERT_TRUE(ring.pop(record));
+    EXPECT_EQ(LogTag::INPUT, record.tag);
+    EXPECT_EQ(KEY_A, record.code);
+    ASSERT_TRUE(ring.pop(record));
+    EXPECT_EQ(LogTag::MAPPED_KEY, record.tag);
+    EXPECT_EQ(KEY_B, record.code);
+    EXPECT_FALSE(ring.pop(record));
+}
+
+TEST(Log, trace_ring_drops_when_full) {
+    TraceRing ring;
+    for (size_t i = 0; i < TraceRing::CAPACITY; i++) {
+        EXPECT_TRUE(ring.push(TraceRecord{i, 1, KEY_A, LogTag::INPUT}));
+    }
+    EXPECT_FALSE(ring.push(TraceRecord{0, 1, KEY_A, LogTag::INPUT}));
+    EXPECT_EQ(1, ring.dropped.load());
+}
@@ -1,4 +1,5 @@
 #include "test_utils.h"
+#include "utils.h"
 
 TYPE_EVENTS empty_items;
 
@@ -178,3 +179,84 @@ TEST(Layer, prefix_and_mapped_with_mod) {
 }
 
 
+TEST(Layer, active_layer_index) {
+    auto r = test_run(TYPE_EVENTS({{1, "N"}}), empty_items, false);
+    ASSERT_NE(nullptr, r.first.active());
+    EXPECT_EQ(schoenberg::parse_key("N"), r.first.active()->code);
+    EXPECT_EQ(r.first.layers.position(schoenberg::parse_key("N")), r.first.active_layer);
+
+    r = test_run(TYPE_EVENTS({{1, "N"}, {0, "N"}}), empty_items, false);
+    EXPECT_EQ(nullptr, r.first.active());
+    EXPECT_EQ(-1, r.first.active_layer);
+}
+
+TEST(Layer, pressed_keys_are_tracked) {
+    auto setup = setup_test();
+    process(setup.first, setup.second, TYPE_EVENTS({{1, "A"}, {1, "S"}, {1, "D"}, {0, "S"}}));
+    auto &key_state = setup.second.key_state;
+    EXPECT_EQ(2, key_state.count());
+    EXPECT_TRUE(key_state.down(schoenberg::parse_key("A")));
+    EXPECT_FALSE(key_state.down(schoenberg::parse_key("S")));
+
+    vector<int> pressed;
+    key_state.for_each([&](int code) { pressed.push_back(code); });
+    EXPECT_EQ(vector<int>({schoenberg::parse_key("A"), schoenberg::parse_key("D")}), pressed);
+
+    process(setup.first, setup.second, TYPE_EVENTS({{0, "A"}, {0, "D"}}));
+    EXPECT_FALSE(key_state.any());
+}
+
+
+// the frames as lists of (value, key), split where the engine ended a frame
+vector<TYPE_EVENTS> frames(const OutputSpan &out) {
+    vector<TYPE_EVENTS> res;
+    out.for_each_frame([&](const input_event *events, size_t count) {
+        TYPE_EVENTS frame;
+        for (size_t i = 0; i < count; i++) {
+            frame.push_back({(__u16) events[i].value, schoenberg::serialize_key(events[i].code)});
+        }
+        res.push_back(frame);
+    });
+    return res;
+}
+
+TEST(Frames, modifier_is_its_own_frame) {
+    auto setup = setup_test();
+    auto &config = setup.first;
+    auto &state = setup.second;
+    OutputBuffer<> out;
+    NulOStream logs;
+    schoenberg::process(config, state, {.type = EV_KEY, .code = KEY_F, .value = 1}, out, logs);
+    EXPECT_TRUE(out.empty());
+
+    schoenberg::process(config, state, {.type = EV_KEY, .code = KEY_U, .value = 1}, out, logs);
+    EXPECT_EQ(vector<TYPE_EVENTS>({{{1, "LEFTSHIFT"}}, {{1, "LEFTBRACE"}}}), frames(out));
+
+    out.clear();
+    schoenberg::process(config, state, {.type = EV_KEY, .code = KEY_U, .value = 0}, out, logs);
+    EXPECT_EQ(vector<TYPE_EVENTS>({{{0, "LEFTBRACE"}}, {{0, "LEFTSHIFT"}}}), frames(out));
+}
+
+TEST(Frames, tap_is_split) {
+    auto setup = setup_test();
+    OutputBuffer<> out;
+    NulOStream logs;
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_F, .value = 1}, out, logs);
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_F, .value = 0}, out, logs);
+    EXPECT_EQ(vector<TYPE_EVENTS>({{{1, "F"}}, {{0, "F"}}}), frames(out));
+
+    // an unused prefix written before an unmapped key: the key joins the frame of the release
+    out.clear();
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_F, .value = 1}, out, logs);
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_G, .value = 1}, out, logs);
+    EXPECT_EQ(vector<TYPE_EVENTS>({{{1, "F"}}, {{0, "F"}, {1, "G"}}}), frames(out));
+}
+
+TEST(Frames, plain_keys_stay_in_one_frame) {
+    auto setup = setup_test();
+    OutputBuffer<> out;
+    NulOStream logs;
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_A, .value = 1}, out, logs);
+    schoenberg::process(setup.first, setup.second, {.type = EV_KEY, .code = KEY_S, .value = 1}, out, logs);
+    EXPECT_EQ(1, frames(out).size());
+}
@@ -0,0 +1,90 @@
+#include "test_utils.h"
+#include "profile.h"
+#include "utils.h"
+#include <unistd.h>
+
+using namespace schoenberg;
+
+namespace {
+
+    string socket_path() {
+        return "/tmp/schoenberg-profile-" + std::to_string(getpid()) + ".sock";
+    }
+
+    class ProfileTest : public ::testing::Test {
+    protected:
+        Profiles profiles;
+
+        void SetUp() override {
+            profiles.add("default", read_config("tst/test.yaml"));
+            profiles.add("plain", Config({}, KeyTable()));
+        }
+    };
+
+}
+
+TEST_F(ProfileTest, finds_profiles_by_name) {
+    EXPECT_EQ(0, profiles.find("default"));
+    EXPECT_EQ(1, profiles.find("plain"));
+    EXPECT_EQ(-1, profiles.find("other"));
+    EXPECT_THROW(profiles.add("plain", Config({}, KeyTable())), std::runtime_error);
+}
+
+TEST_F(ProfileTest, switches_once_nothing_is_held) {
+    ProfileEngines engines(profiles);
+    auto first = engines.current();
+    EXPECT_EQ(first, engines.select());
+    EXPECT_EQ(Events({{KEY_ESC, 1}}), run(*first, KEY_CAPSLOCK, 1));
+
+    // CAPSLOCK is held, its release has to reach the engine that pressed it
+    profiles.select(1);
+    EXPECT_EQ(first, engines.select());
+    EXPECT_EQ(Events({{KEY_ESC, 0}}), run(*first, KEY_CAPSLOCK, 0));
+
+    auto second = engines.select();
+    EXPECT_NE(first, second);
+    EXPECT_EQ(1u, engines.current_profile());
+    EXPECT_EQ(Events({{KEY_CAPSLOCK, 1}}), run(*second, KEY_CAPSLOCK, 1));
+    EXPECT_EQ(Events({{KEY_CAPSLOCK, 0}}), run(*second, KEY_CAPSLOCK, 0));
+
+    profiles.select(0);
+    EXPECT_EQ(first, engines.select());
+}
+
+TEST_F(ProfileTest, every_event_loop_has_its_own_engines) {
+    ProfileEngines a(profiles);
+    ProfileEngines b(profiles);
+    run(*a.current(), KEY_A, 1);
+    profiles.select(1);
+    // a holds a key and stays, b is idle and switches
+    a.select();
+    b.select();
+    EXPECT_EQ(0u, a.current_profile());
+    EXPECT_EQ(1u, b.current_profile());
+}
+
+TEST_F(ProfileTest, handles_requests) {
+    NulOStream errors;
+    ProfileControl control(profiles, socket_path(), errors);
+    EXPECT_EQ("* default\n  plain\n", control.handle("list"));
+    EXPECT_EQ("ok plain\n", control.handle("use plain"));
+    EXPECT_EQ(1u, profiles.requested());
+    EXPECT_EQ("  default\n* plain\n", control.handle("list"));
+    EXPECT_EQ("error unknown profile other\n", control.handle("use other"));
+    EXPECT_EQ(1u, profiles.requested());
+    EXPECT_EQ("error unknown request switch\n", control.handle("switch"));
+}
+
+TEST_F(ProfileTest, switches_over_the_socket) {
+    NulOStream errors;
+    auto path = socket_path();
+    {
+        ProfileControl control(profiles, path, errors);
+        EXPECT_EQ("ok plain\n", control_request(path, "use plain"));
+        EXPECT_EQ(1u, profiles.requested());
+        EXPECT_EQ("  default\n* plain\n", control_request(path, "list"));
+    }
+    // the socket is removed with the control
+    EXPECT_NE(0, access(path.c_str(), F_OK));
+    EXPECT_THROW(control_request(path, "list"), std::runtime_error);
+}
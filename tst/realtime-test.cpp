@@ -0,0 +1,34 @@
+#include "gtest/gtest.h"
+#include "realtime.h"
+#include <sched.h>
+#include <sstream>
+
+using namespace schoenberg;
+
+TEST(Realtime, nothing_requested) {
+    RealtimeOptions options;
+    options.lock = false;
+    std::stringstream report;
+    auto status = enter_realtime(options, report);
+    EXPECT_FALSE(status.scheduled);
+    EXPECT_FALSE(status.pinned);
+    EXPECT_FALSE(status.locked);
+    EXPECT_EQ("", report.str());
+}
+
+TEST(Realtime, invalid_cpu_is_reported) {
+    RealtimeOptions options;
+    options.lock = false;
+    options.cpu = CPU_SETSIZE + 1;
+    std::stringstream report;
+    auto status = enter_realtime(options, report);
+    EXPECT_FALSE(status.pinned);
+    EXPECT_NE(std::string::npos, report.str().find("can not pin to cpu"));
+}
+
+TEST(Realtime, prefault_engine) {
+    Engine engine(read_config("./tst/test.yaml"));
+    prefault(engine);
+    prefault_stack(64 * 1024);
+    prefault(nullptr, 0);
+}
@@ -0,0 +1,231 @@
+#include "gtest/gtest.h"
+#include "io.h"
+#include "pipeline.h"
+#include "record.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+using namespace schoenberg;
+
+string trace_file() {
+    char file[] = "/tmp/schoenberg-trace-XXXXXX";
+    auto fd = mkstemp(file);
+    EXPECT_GE(fd, 0);
+    close(fd);
+    return file;
+}
+
+input_event trace_event(__u16 type, __u16 code, int value) {
+    return input_event{.type = type, .code = code, .value = value};
+}
+
+TEST(Record, round_trip_and_append) {
+    auto file = trace_file();
+    {
+        Recorder recorder(file);
+        recorder.input(trace_event(EV_KEY, KEY_A, 1));
+        recorder.output(trace_event(EV_KEY, KEY_B, 1));
+    }
+    {
+        Recorder recorder(file);
+        EXPECT_EQ(2, recorder.size());
+        recorder.input(trace_event(EV_SYN, SYN_REPORT, 0));
+    }
+    Trace trace(file);
+    ASSERT_EQ(3, trace.size());
+    EXPECT_EQ(RecordedEvent::INPUT, trace.begin()[0].direction);
+    EXPECT_EQ(KEY_A, trace.begin()[0].event.code);
+    EXPECT_EQ(RecordedEvent::OUTPUT, trace.begin()[1].direction);
+    EXPECT_EQ(KEY_B, trace.begin()[1].event.code);
+    EXPECT_EQ(EV_SYN, trace.begin()[2].event.type);
+    unlink(file.c_str());
+}
+
+TEST(Record, grows_past_the_preallocation) {
+    auto file = trace_file();
+    auto count = Recorder::CHUNK * 2 + 10;
+    {
+        Recorder recorder(file);
+        for (size_t i = 0; i < count; i++) {
+            recorder.input(trace_event(EV_REL, REL_X, i));
+        }
+    }
+    Trace trace(file);
+    ASSERT_EQ(count, trace.size());
+    EXPECT_EQ(int(count - 1), trace.begin()[count - 1].event.value);
+    unlink(file.c_str());
+}
+
+TEST(Record, refuses_other_files) {
+    auto file = trace_file();
+    std::ofstream(file) << "not a trace, but long enough to have a header";
+    EXPECT_THROW(Recorder recorder(file), std::runtime_error);
+    EXPECT_THROW(Trace trace(file), std::runtime_error);
+    unlink(file.c_str());
+}
+
+TEST(Record, reader_and_writer_record_the_session) {
+    auto file = trace_file();
+    Engine engine(read_config("./tst/test.yaml"));
+    int in[2], out[2];
+    ASSERT_EQ(0, pipe(in));
+    ASSERT_EQ(0, pipe(out));
+    std::vector<input_event> events = {
+            trace_event(EV_REL, REL_X, 3), trace_event(EV_SYN, SYN_REPORT, 0),
+            trace_event(EV_KEY, KEY_CAPSLOCK, 1), trace_event(EV_SYN, SYN_REPORT, 0),
+    };
+    ASSERT_EQ(events.size() * sizeof(input_event),
+              write(in[1], events.data(), events.size() * sizeof(input_event)));
+    {
+        Recorder recorder(file);
+        EventReader reader(in[0]);
+        EventWriter writer(out[1]);
+        reader.record(&recorder);
+        writer.record(&recorder);
+        OutputBuffer<> output;
+        ASSERT_TRUE(reader.fill());
+        forward_ready(engine, reader, output, writer, NoLog());
+        ASSERT_TRUE(writer.flush());
+    }
+
+    Trace trace(file);
+    std::vector<pair<uint32_t, int>> recorded;
+    for (const auto &record: trace) {
+        recorded.emplace_back(record.direction, record.event.code);
+    }
+    // the passed through frame is recorded as it is taken from the input
+    EXPECT_EQ((std::vector<pair<uint32_t, int>>{
+            {RecordedEvent::INPUT, REL_X}, {RecordedEvent::INPUT, SYN_REPORT},
+            {RecordedEvent::OUTPUT, REL_X}, {RecordedEvent::OUTPUT, SYN_REPORT},
+            {RecordedEvent::INPUT, KEY_CAPSLOCK}, {RecordedEvent::OUTPUT, KEY_ESC},
+            {RecordedEvent::INPUT, SYN_REPORT}, {RecordedEvent::OUTPUT, SYN_REPORT},
+    }), recorded);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    unlink(file.c_str());
+}
+
+namespace {
+
+    // a key event and its SYN_REPORT, ms after the start of the session
+    struct Step {
+        int ms;
+        int code;
+        int value;
+    };
+
+    // the steps typed in real time into schoenberg_run --record, the input ends at end ms. returns the trace
+    string record_session(const string &config_file, const std::vector<Step> &steps, int end) {
+        auto file = trace_file();
+        int in[2], out[2];
+        EXPECT_EQ(0, pipe(in));
+        EXPECT_EQ(0, pipe(out));
+        auto pid = fork();
+        if (pid == 0) {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            close(STDERR_FILENO);
+            close(in[0]), close(in[1]), close(out[0]), close(out[1]);
+            execl(SCHOENBERG_RUN, SCHOENBERG_RUN, "--no-watch", "--record", file.c_str(), config_file.c_str(),
+                  (char *) nullptr);
+            _exit(127);
+        }
+        close(in[0]), close(out[1]);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &step: steps) {
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(step.ms));
+            timeval now;
+            gettimeofday(&now, nullptr);
+            input_event frame[] = {trace_event(EV_KEY, step.code, step.value), trace_event(EV_SYN, SYN_REPORT, 0)};
+            frame[0].time = frame[1].time = now;
+            EXPECT_EQ(sizeof(frame), write(in[1], frame, sizeof(frame)));
+        }
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(end));
+        close(in[1]);
+        char buffer[4096];
+        while (read(out[0], buffer, sizeof(buffer)) > 0) {
+        }
+        close(out[0]);
+        int status;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return file;
+    }
+
+    std::vector<std::tuple<int, int, int>> events_of(const std::vector<input_event> &events) {
+        std::vector<std::tuple<int, int, int>> res;
+        for (const auto &event: events) {
+            res.emplace_back(event.type, event.code, event.value);
+        }
+        return res;
+    }
+
+    // replays the input of the trace like schoenberg_replay, the output has to be the recorded one
+    void expect_replayed(const string &config_file, const string &file) {
+        std::vector<input_event> inputs, recorded;
+        uint64_t end = 0;
+        for (const auto &record: Trace(file)) {
+            (record.direction == RecordedEvent::INPUT ? inputs : recorded).push_back(record.event);
+            end = std::max(end, uint64_t(record.event.time.tv_sec) * 1000000000 + record.event.time.tv_usec * 1000);
+        }
+        auto in = memfd_create("schoenberg-replay-in", 0);
+        auto out = memfd_create("schoenberg-replay-out", 0);
+        ASSERT_EQ(inputs.size() * sizeof(input_event), write(in, inputs.data(), inputs.size() * sizeof(input_event)));
+        lseek(in, 0, SEEK_SET);
+
+        Engine engine(read_config(config_file));
+        EventReader reader(in);
+        EventWriter writer(out);
+        OutputBuffer<> output;
+        while (reader.fill()) {
+            forward_recorded(engine, reader, output, writer, NoLog());
+        }
+        forward_expired_until(engine, end + 1, output, writer, NoLog());
+        ASSERT_TRUE(writer.flush());
+
+        std::vector<input_event> replayed(lseek(out, 0, SEEK_END) / sizeof(input_event));
+        ASSERT_EQ(replayed.size() * sizeof(input_event),
+                  pread(out, replayed.data(), replayed.size() * sizeof(input_event), 0));
+        EXPECT_EQ(events_of(recorded), events_of(replayed));
+        close(in);
+        close(out);
+    }
+
+    bool wrote(const string &file, int code, int value) {
+        for (const auto &record: Trace(file)) {
+            if (record.direction == RecordedEvent::OUTPUT && record.event.code == code &&
+                record.event.value == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
+
+TEST(Record, replays_a_session_with_tapping_terms) {
+    // J is held back until the tapping term of F runs out, then written on its own. a tap of F, then a hold
+    // that is only decided by the timer, no input follows it
+    auto file = record_session("tst/taphold.yaml", {{0,   KEY_F, 1}, {50,  KEY_J, 1}, {300, KEY_J, 0},
+                                                    {350, KEY_F, 0}, {400, KEY_F, 1}, {450, KEY_F, 0},
+                                                    {500, KEY_F, 1}, {550, KEY_J, 1}}, 800);
+    EXPECT_TRUE(wrote(file, KEY_DOWN, 1));
+    expect_replayed("tst/taphold.yaml", file);
+    unlink(file.c_str());
+}
+
+TEST(Record, replays_a_session_with_generated_repeats) {
+    // repeats after 200 ms, then every 40 ms: at 200, 240 and 280
+    auto file = record_session("tst/repeat.yaml", {{0, KEY_CAPSLOCK, 1}, {300, KEY_CAPSLOCK, 0}}, 300);
+    EXPECT_TRUE(wrote(file, KEY_ESC, 2));
+    expect_replayed("tst/repeat.yaml", file);
+    unlink(file.c_str());
+}
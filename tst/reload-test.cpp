@@ -0,0 +1,125 @@
+#include "test_utils.h"
+#include "reload.h"
+#include "utils.h"
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+// a config in a directory of its own, removed again with the test
+class TempConfig {
+public:
+    explicit TempConfig(const string &mapping) {
+        char dir[] = "/tmp/schoenberg-reload-XXXXXX";
+        EXPECT_NE(nullptr, mkdtemp(dir));
+        this->dir = dir;
+        file = this->dir + "/config.yaml";
+        std::ofstream(file) << mapping;
+    }
+
+    ~TempConfig() {
+        unlink(file.c_str());
+        unlink((file + ".tmp").c_str());
+        rmdir(dir.c_str());
+    }
+
+    string dir;
+    string file;
+};
+
+bool wait_ready(ConfigReloader &reloader) {
+    for (int i = 0; i < 200 && !reloader.ready(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return reloader.ready();
+}
+
+int mapped(Engine &engine, int code) {
+    return engine.config.keys.lookup(code).key;
+}
+
+TEST(Reload, picks_up_changed_file) {
+    TempConfig config("mapping:\n  A: B\n");
+    auto &file = config.file;
+    NulOStream errors;
+    ConfigReloader reloader(file, true, errors);
+    auto engine = new Engine(read_config(file));
+    EXPECT_EQ(KEY_B, mapped(*engine, KEY_A));
+
+    // written elsewhere and moved into place, like editors do
+    std::ofstream(file + ".tmp") << "mapping:\n  A: C\n";
+    ASSERT_EQ(0, rename((file + ".tmp").c_str(), file.c_str()));
+
+    ASSERT_TRUE(wait_ready(reloader));
+    engine = reloader.swap(engine);
+    EXPECT_EQ(KEY_C, mapped(*engine, KEY_A));
+    EXPECT_FALSE(reloader.ready());
+    delete engine;
+}
+
+TEST(Reload, keeps_config_on_error) {
+    TempConfig config("mapping:\n  A: B\n");
+    auto &file = config.file;
+    NulOStream errors;
+    ConfigReloader reloader(file, true, errors);
+
+    std::ofstream(file) << "mapping:\n  A: NOT_A_KEY\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(reloader.ready());
+}
+
+TEST(Reload, reloads_on_sighup) {
+    TempConfig config("mapping:\n  A: B\n");
+    auto &file = config.file;
+    ConfigReloader::block_reload_signal();
+    NulOStream errors;
+    ConfigReloader reloader(file, false, errors);
+
+    kill(getpid(), SIGHUP);
+    ASSERT_TRUE(wait_ready(reloader));
+    auto engine = reloader.swap(nullptr);
+    EXPECT_EQ(KEY_B, mapped(*engine, KEY_A));
+    delete engine;
+}
+
+TEST(Reload, takes_one_change_after_the_other) {
+    TempConfig config("mapping:\n  A: B\n");
+    auto &file = config.file;
+    NulOStream errors;
+    ConfigReloader reloader(file, true, errors);
+    auto engine = new Engine(read_config(file));
+
+    for (auto key: {"C", "D", "E"}) {
+        std::ofstream(file + ".tmp") << "mapping:\n  A: " << key << "\n";
+        ASSERT_EQ(0, rename((file + ".tmp").c_str(), file.c_str()));
+        // ready once the reload thread freed the engine retired by the last swap
+        ASSERT_TRUE(wait_ready(reloader));
+        engine = reloader.swap(engine);
+        EXPECT_EQ(parse_key(key), mapped(*engine, KEY_A));
+    }
+    delete engine;
+}
+
+TEST(Reload, keeps_the_toggled_layers) {
+    string layers = "layers:\n  - name: numbers\n    prefix: D\n    toggle: true\n    keys:\n      J: 1\n";
+    TempConfig config(layers);
+    auto &file = config.file;
+    NulOStream errors;
+    ConfigReloader reloader(file, true, errors);
+    auto engine = new Engine(read_config(file));
+    run(*engine, KEY_D, 1);
+    run(*engine, KEY_D, 0);
+    ASSERT_TRUE(engine->idle());
+
+    std::ofstream(file + ".tmp") << layers << "      K: 2\n";
+    ASSERT_EQ(0, rename((file + ".tmp").c_str(), file.c_str()));
+    ASSERT_TRUE(wait_ready(reloader));
+    engine = reloader.swap(engine);
+    EXPECT_EQ(Events({{KEY_2, 1}}), run(*engine, KEY_K, 1));
+    EXPECT_TRUE(engine->state.layers[KEY_D].toggled);
+    delete engine;
+}
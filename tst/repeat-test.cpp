@@ -0,0 +1,81 @@
+#include "test_utils.h"
+
+using namespace schoenberg;
+
+namespace {
+
+    class Repeat : public EngineTest {
+    protected:
+        Repeat() : EngineTest(test_config()) {}
+
+        void generating() {
+            config = read_config("tst/repeat.yaml");
+            rebuild();
+        }
+    };
+
+}
+
+TEST_F(Repeat, repeats_the_key_the_press_wrote) {
+    run(KEY_CAPSLOCK, 1);
+    EXPECT_EQ(Events({{KEY_ESC, 2}}), run(KEY_CAPSLOCK, 2));
+    EXPECT_EQ(Events({{KEY_ESC, 0}}), run(KEY_CAPSLOCK, 0));
+
+    // with a mod only the key repeats, the mod stays down
+    run(KEY_F, 1);
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_LEFTBRACE, 1}}), run(KEY_U, 1));
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 2}}), run(KEY_U, 2));
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 2}}), run(KEY_U, 2));
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 0}, {KEY_LEFTSHIFT, 0}}), run(KEY_U, 0));
+    EXPECT_FALSE(state.repeat.active());
+}
+
+TEST_F(Repeat, leaving_the_layer_ends_the_repeats) {
+    run(KEY_F, 1);
+    EXPECT_EQ(Events({{KEY_LEFT, 1}}), run(KEY_H, 1));
+    EXPECT_EQ(Events({{KEY_LEFT, 0}}), run(KEY_F, 0));
+    // the press was an arrow, its repeats are not H
+    EXPECT_EQ(Events(), run(KEY_H, 2));
+}
+
+TEST_F(Repeat, prefix_written_as_a_key_repeats) {
+    run(KEY_A, 1);
+    // a key is down, so F is written instead of switching to its layer
+    EXPECT_EQ(Events({{KEY_F, 1}}), run(KEY_F, 1));
+    EXPECT_EQ(Events({{KEY_F, 2}}), run(KEY_F, 2));
+}
+
+TEST_F(Repeat, prefix_repeats_still_use_the_layer) {
+    run(KEY_F, 1);
+    EXPECT_FALSE(state.repeat.active());
+    run(KEY_F, 2);
+    // held long enough to repeat is no tap
+    EXPECT_EQ(Events(), run(KEY_F, 0));
+}
+
+TEST_F(Repeat, generated_at_the_rate) {
+    generating();
+    EXPECT_TRUE(state.timed());
+    EXPECT_EQ(Events({{KEY_ESC, 1}}), run(KEY_CAPSLOCK, 1, 0));
+    EXPECT_EQ(time_at(200), next_deadline(state));
+    // the repeats of the kernel are dropped
+    EXPECT_EQ(Events(), run(KEY_CAPSLOCK, 2, 150));
+    EXPECT_EQ(Events(), expire_at(199));
+    EXPECT_EQ(Events({{KEY_ESC, 2}}), expire_at(200));
+    EXPECT_EQ(Events({{KEY_ESC, 2}}), expire_at(240));
+    // a late timer writes one repeat, not a burst
+    EXPECT_EQ(Events({{KEY_ESC, 2}}), expire_at(500));
+    EXPECT_EQ(time_at(540), next_deadline(state));
+    EXPECT_EQ(Events({{KEY_ESC, 0}}), run(KEY_CAPSLOCK, 0, 510));
+    EXPECT_EQ(0, next_deadline(state));
+}
+
+TEST_F(Repeat, generated_inside_a_layer) {
+    generating();
+    run(KEY_F, 1, 0);
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_LEFTBRACE, 1}}), run(KEY_U, 1, 10));
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 2}}), expire_at(210));
+    // the layer is left while U is held: the key is released and the repeats stop
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 0}, {KEY_LEFTBRACE, 0}}), run(KEY_F, 0, 220));
+    EXPECT_EQ(0, next_deadline(state));
+}
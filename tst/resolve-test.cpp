@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "schoenberg.h"
+#include "utils.h"
+#include <set>
+
+using namespace schoenberg;
+
+vector<pair<int, int>> as_pairs(const OutputSpan &events) {
+    vector<pair<int, int>> res;
+    for (const auto &e: events) {
+        res.emplace_back(e.code, e.value);
+    }
+    return res;
+}
+
+vector<size_t> frame_ends(const OutputSpan &events) {
+    vector<size_t> res;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events.frame_end(i)) {
+            res.push_back(i);
+        }
+    }
+    return res;
+}
+
+vector<int> pressed(const State &state) {
+    vector<int> res;
+    state.key_state.for_each([&](int code) { res.push_back(code); });
+    return res;
+}
+
+// the precomputed tables have to give exactly what process_mapping + process_for_layer give
+TEST(Resolve, matches_two_pass_processing) {
+    auto config = read_config("tst/test.yaml");
+    auto fused = build_state(config);
+    auto two_pass = build_state(config);
+    const char *keys[] = {"F", "N", "H", "J", "U", "I", "S", "A", "G", "CAPSLOCK", "GRAVE", "EQUAL", "ESC",
+                          "LEFTSHIFT"};
+    NulOStream logs;
+
+    uint32_t seed = 7;
+    auto in_layer = 0;
+    std::set<int> held;
+    for (int i = 0; i < 20000; i++) {
+        seed = seed * 1664525 + 1013904223;
+        auto code = parse_key(keys[(seed >> 8) % (sizeof(keys) / sizeof(keys[0]))]);
+        // typing: at most a few keys down at once, held keys are mostly released, sometimes repeated
+        if (held.size() >= 3 || (!held.empty() && (seed >> 16) % 2)) {
+            code = *std::next(held.begin(), (seed >> 4) % held.size());
+        }
+        auto value = !held.count(code) ? 1 : ((seed >> 20) % 4 ? 0 : 2);
+        if (value == 1) {
+            held.insert(code);
+        } else if (value == 0) {
+            held.erase(code);
+        }
+        auto event = input_event{.type = EV_KEY, .code = (__u16) code, .value = (int) value};
+
+        OutputBuffer<> expected;
+        if (value == 2 && code == fused.repeat.code) {
+            // the key pressed last repeats what its press wrote, while that is down
+            if (two_pass.key_state.down(fused.repeat.key)) {
+                expected.push(input_event{.type = EV_KEY, .code = (__u16) fused.repeat.key, .value = 2});
+            }
+        } else {
+            OutputBuffer<3> mapped;
+            process_mapping(config, event, mapped, logs);
+            for (size_t j = 0; j < mapped.size(); j++) {
+                process_for_layer(two_pass, mapped[j], expected, logs);
+                if (mapped.frame_end(j)) {
+                    expected.end_frame();
+                }
+            }
+        }
+        OutputBuffer<> actual;
+        process(config, fused, event, actual);
+
+        ASSERT_EQ(as_pairs(expected), as_pairs(actual)) << "event " << i;
+        ASSERT_EQ(frame_ends(expected), frame_ends(actual)) << "event " << i;
+        ASSERT_EQ(pressed(two_pass), pressed(fused)) << "event " << i;
+        ASSERT_EQ(two_pass.active_layer, fused.active_layer) << "event " << i;
+        in_layer += fused.active_layer >= 0;
+        for (auto &layer: two_pass.layers) {
+            auto &other = fused.layers.at(layer.code);
+            ASSERT_EQ(layer.used, other.used) << "event " << i;
+            ASSERT_EQ(layer.written, other.written) << "event " << i;
+        }
+    }
+    // the sequence has to actually exercise the layers
+    EXPECT_GT(in_layer, 1000);
+}
+
+TEST(Resolve, prefix_takes_general_path) {
+    auto config = read_config("tst/test.yaml");
+    auto state = build_state(config);
+    EXPECT_TRUE(state.resolved[0][parse_key("F")].flags & Resolution::GENERAL);
+    EXPECT_FALSE(state.resolved[0][parse_key("H")].flags & Resolution::GENERAL);
+
+    // U in the F layer: LEFTSHIFT before LEFTBRACE on press, after it on release
+    auto slot = state.layers.position(parse_key("F")) + 1;
+    const auto &u = state.resolved[slot][parse_key("U")];
+    ASSERT_EQ(2, u.count[1]);
+    EXPECT_EQ(parse_key("LEFTSHIFT"), u.steps[1][0].code);
+    EXPECT_EQ(parse_key("LEFTBRACE"), u.steps[1][1].code);
+    ASSERT_EQ(2, u.count[0]);
+    EXPECT_EQ(parse_key("LEFTBRACE"), u.steps[0][0].code);
+    EXPECT_EQ(parse_key("LEFTSHIFT"), u.steps[0][1].code);
+    // the modifier is a frame of its own
+    EXPECT_EQ(1, u.ends[1]);
+    EXPECT_EQ(1, u.ends[0]);
+    EXPECT_TRUE(state.resolved[slot][parse_key("G")].flags & Resolution::TAP_PREFIX);
+}
@@ -0,0 +1,100 @@
+#include "test_utils.h"
+#include "snapshot.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace schoenberg;
+
+namespace {
+
+    class Snapshot : public ::testing::Test {
+    protected:
+        string name = "schoenberg-snapshot-test-" + std::to_string(getpid());
+
+        void TearDown() override {
+            shm_unlink(("/" + name).c_str());
+        }
+
+        // the engine of a process that is restarted after the events so far, with the state it left
+        std::unique_ptr<Engine> restart(const Engine &engine) {
+            {
+                auto segment = StateSegment::open(name);
+                segment.save(engine);
+            }
+            auto segment = StateSegment::open(name);
+            auto res = std::make_unique<Engine>(engine.config);
+            EXPECT_TRUE(segment.restore(*res));
+            return res;
+        }
+    };
+
+}
+
+TEST_F(Snapshot, held_layer_is_released_as_it_was_pressed) {
+    Engine engine(read_config("tst/test.yaml"));
+    run(engine, KEY_F, 1);
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_LEFTBRACE, 1}}), run(engine, KEY_U, 1));
+
+    auto next = restart(engine);
+    EXPECT_FALSE(next->idle());
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 0}, {KEY_LEFTSHIFT, 0}}), run(*next, KEY_U, 0));
+    EXPECT_EQ(Events({{KEY_LEFT, 1}}), run(*next, KEY_H, 1));
+    EXPECT_EQ(Events({{KEY_LEFT, 0}}), run(*next, KEY_H, 0));
+    // the layer was used, its release writes nothing
+    EXPECT_EQ(Events(), run(*next, KEY_F, 0));
+    EXPECT_TRUE(next->idle());
+}
+
+TEST_F(Snapshot, pending_prefix_is_still_decided) {
+    Engine engine(read_config("tst/taphold.yaml"));
+    EXPECT_EQ(Events(), run(engine, KEY_F, 1, 0));
+    EXPECT_EQ(Events(), run(engine, KEY_J, 1, 50));
+
+    auto next = restart(engine);
+    EXPECT_EQ(time_at(180), next_deadline(next->state));
+    OutputBuffer<> out;
+    expire(next->config, next->state, time_at(180), out);
+    ASSERT_EQ(1u, out.size());
+    EXPECT_EQ(KEY_DOWN, out[0].code);
+    EXPECT_EQ(Events({{KEY_DOWN, 0}}), run(*next, KEY_J, 0, 200));
+}
+
+TEST_F(Snapshot, adopted_state_is_saved_again) {
+    Engine engine(read_config("tst/test.yaml"));
+    run(engine, KEY_CAPSLOCK, 1);
+    // a process that adopts the state and is restarted again before the key is released
+    auto next = restart(*restart(engine));
+    EXPECT_EQ(Events({{KEY_ESC, 0}}), run(*next, KEY_CAPSLOCK, 0));
+}
+
+TEST_F(Snapshot, other_config_does_not_adopt) {
+    Engine engine(read_config("tst/test.yaml"));
+    run(engine, KEY_CAPSLOCK, 1);
+    StateSegment::open(name).save(engine);
+
+    Engine other(read_config("tst/taphold.yaml"));
+    EXPECT_FALSE(StateSegment::open(name).restore(other));
+    EXPECT_TRUE(other.idle());
+    EXPECT_NE(fingerprint(engine.config), fingerprint(other.config));
+    EXPECT_EQ(fingerprint(engine.config), fingerprint(read_config("tst/test.yaml")));
+}
+
+TEST_F(Snapshot, new_segment_has_no_state) {
+    Engine engine(read_config("tst/test.yaml"));
+    EXPECT_FALSE(StateSegment::open(name).restore(engine));
+}
+
+TEST_F(Snapshot, interrupted_save_is_not_adopted) {
+    Engine engine(read_config("tst/test.yaml"));
+    run(engine, KEY_CAPSLOCK, 1);
+    auto segment = StateSegment::open(name);
+    segment.save(engine);
+    // a writer that died in the middle of a save
+    segment.snapshot->sequence.fetch_add(1);
+    Engine next(engine.config);
+    EXPECT_FALSE(segment.restore(next));
+
+    // the next save is consistent again
+    segment.save(engine);
+    EXPECT_TRUE(segment.restore(next));
+}
@@ -0,0 +1,131 @@
+#include "test_utils.h"
+#include "cache.h"
+
+using namespace schoenberg;
+
+namespace {
+
+    class Stack : public EngineTest {
+    protected:
+        Stack() : EngineTest(read_config("tst/stack.yaml")) {}
+
+        Events tap(int code) {
+            auto res = run(code, 1);
+            auto up = run(code, 0);
+            res.insert(res.end(), up.begin(), up.end());
+            return res;
+        }
+
+        uint64_t bit(int code) {
+            return uint64_t(1) << state.layers.position(code);
+        }
+    };
+
+}
+
+TEST_F(Stack, tap_switches_a_toggle_layer) {
+    EXPECT_EQ(Events(), tap(KEY_D));
+    EXPECT_EQ(bit(KEY_D), state.stack);
+    EXPECT_EQ(nullptr, state.active());
+    EXPECT_EQ(Events({{KEY_1, 1}, {KEY_1, 0}}), tap(KEY_J));
+    // unmapped keys are written as they are, there is no prefix to write
+    EXPECT_EQ(Events({{KEY_A, 1}, {KEY_A, 0}}), tap(KEY_A));
+
+    EXPECT_EQ(Events(), tap(KEY_D));
+    EXPECT_EQ(0, state.stack);
+    EXPECT_EQ(Events({{KEY_J, 1}, {KEY_J, 0}}), tap(KEY_J));
+}
+
+TEST_F(Stack, toggle_layer_is_momentary_when_held) {
+    run(KEY_D, 1);
+    EXPECT_EQ(Events({{KEY_2, 1}, {KEY_2, 0}}), tap(KEY_K));
+    EXPECT_EQ(Events(), run(KEY_D, 0));
+    EXPECT_EQ(0, state.stack);
+    EXPECT_FALSE(state.layers[KEY_D].toggled);
+}
+
+TEST_F(Stack, layers_stack_and_fall_through) {
+    run(KEY_F, 1);
+    // D is not mapped in the arrows, so its layer goes on top
+    EXPECT_EQ(Events(), run(KEY_D, 1));
+    EXPECT_EQ(bit(KEY_F) | bit(KEY_D), state.stack);
+    EXPECT_EQ(KEY_D, state.active()->code);
+    EXPECT_TRUE(state.layers[KEY_F].used);
+
+    // the numbers are on top, H is not mapped there and falls through to the arrows
+    EXPECT_EQ(Events({{KEY_1, 1}, {KEY_1, 0}}), tap(KEY_J));
+    EXPECT_EQ(Events({{KEY_LEFT, 1}, {KEY_LEFT, 0}}), tap(KEY_H));
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_3, 1}}), run(KEY_L, 1));
+    EXPECT_TRUE(out.frame_end(0));
+    run(KEY_L, 0);
+
+    EXPECT_EQ(Events(), run(KEY_D, 0));
+    EXPECT_EQ(KEY_F, state.active()->code);
+    EXPECT_EQ(Events({{KEY_DOWN, 1}, {KEY_DOWN, 0}}), tap(KEY_J));
+    EXPECT_EQ(Events(), run(KEY_F, 0));
+    EXPECT_EQ(0, state.stack);
+}
+
+TEST_F(Stack, momentary_layer_on_a_toggled_one) {
+    tap(KEY_D);
+    run(KEY_F, 1);
+    EXPECT_EQ(Events({{KEY_LEFT, 1}, {KEY_LEFT, 0}}), tap(KEY_H));
+    run(KEY_F, 0);
+    // the toggled layer stays
+    EXPECT_EQ(bit(KEY_D), state.stack);
+    EXPECT_EQ(Events({{KEY_1, 1}, {KEY_1, 0}}), tap(KEY_J));
+}
+
+TEST_F(Stack, unused_prefix_on_a_toggled_layer_is_written) {
+    tap(KEY_D);
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}}), tap(KEY_F));
+    EXPECT_EQ(bit(KEY_D), state.stack);
+}
+
+TEST_F(Stack, stacks_are_resolved_with_the_config) {
+    // empty, F, D and F with D
+    EXPECT_EQ(4u, state.resolved.size());
+    run(KEY_F, 1);
+    run(KEY_D, 1);
+    tap(KEY_J);
+    EXPECT_EQ(4u, state.resolved.size());
+    EXPECT_EQ(state.slots.at(bit(KEY_F) | bit(KEY_D)), state.slot);
+}
+
+TEST(StackResolve, larger_stacks_take_the_general_path) {
+    // 16 toggle layers, J gives the position of the layer: the pairs would be more than MAX_RESOLVED_STACKS tables
+    vector<LayerConfig> layers;
+    const char *prefixes[] = {"F", "D", "S", "A", "G", "Q", "W", "E", "R", "T", "Y", "Z", "X", "C", "V", "B"};
+    for (int i = 0; i < 16; i++) {
+        KeyTable keys;
+        keys[KEY_J] = KeyTarget(KEY_F1 + i, -1);
+        layers.emplace_back(prefixes[i], keys);
+        layers.back().toggle = true;
+    }
+    Config config(layers, KeyTable());
+    auto state = build_state(config);
+    EXPECT_EQ(17u, state.resolved.size());
+
+    OutputBuffer<> out;
+    auto press = [&](int code, int value) {
+        out.clear();
+        process(config, state, key_at(0, code, value), out);
+        return out.size() ? int(out[0].code) : -1;
+    };
+    for (auto code: {KEY_F, KEY_D, KEY_S}) {
+        press(code, 1);
+        press(code, 0);
+    }
+    // the highest of the three toggled layers wins
+    EXPECT_EQ(KEY_F3, press(KEY_J, 1));
+    EXPECT_EQ(-1, state.slot);
+    EXPECT_EQ(KEY_F3, press(KEY_J, 0));
+    EXPECT_EQ(17u, state.resolved.size());
+}
+
+TEST(StackConfig, toggle_is_parsed) {
+    auto config = read_config("tst/stack.yaml");
+    EXPECT_FALSE(config.layers[0].toggle);
+    EXPECT_TRUE(config.layers[1].toggle);
+    EXPECT_TRUE(build_state(config).layers[parse_key("D")].toggle);
+}
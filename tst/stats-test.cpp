@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "stats.h"
+#include "io.h"
+#include <unistd.h>
+
+using namespace schoenberg;
+
+TEST(Stats, buckets_are_ordered_and_narrow) {
+    size_t previous = 0;
+    for (uint64_t ns = 0; ns < 1000000; ns += 1 + ns / 100) {
+        auto bucket = LatencyHistogram::bucket(ns);
+        EXPECT_GE(bucket, previous);
+        previous = bucket;
+        auto floor = LatencyHistogram::bucket_floor(bucket);
+        EXPECT_LE(floor, ns);
+        // at most 12.5% below the value
+        EXPECT_LE(ns - floor, ns / 8) << ns;
+    }
+    EXPECT_EQ(LatencyHistogram::BUCKETS - 1, LatencyHistogram::bucket(uint64_t(1) << 50));
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        EXPECT_EQ(i, LatencyHistogram::bucket(LatencyHistogram::bucket_floor(i)));
+    }
+}
+
+TEST(Stats, percentiles) {
+    auto segment = StatsSegment::create("schoenberg-stats-test", CLOCK_MONOTONIC);
+    auto &histogram = *segment.histogram;
+    for (uint64_t ns = 1; ns <= 1000; ns++) {
+        histogram.record(ns * 1000);
+    }
+    EXPECT_EQ(1000, histogram.count.load());
+    EXPECT_EQ(1000000, histogram.max.load());
+    auto p50 = histogram.percentile(0.5);
+    EXPECT_LE(p50, 501000);
+    EXPECT_GE(p50, 501000 - 501000 / 8);
+
+    // a second process maps the same counters
+    auto reader = StatsSegment::open("schoenberg-stats-test");
+    EXPECT_EQ(1000, reader.histogram->count.load());
+    EXPECT_EQ(CLOCK_MONOTONIC, reader.histogram->clock);
+}
+
+TEST(Stats, missing_segment) {
+    EXPECT_THROW(StatsSegment::open("schoenberg-stats-test-missing"), std::runtime_error);
+}
+
+TEST(Stats, writer_measures_events) {
+    auto segment = StatsSegment::create("schoenberg-stats-test-writer", CLOCK_MONOTONIC);
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    EventWriter writer(fds[1]);
+    writer.measure(segment.histogram, CLOCK_MONOTONIC);
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    input_event event{.type = EV_KEY, .code = KEY_A, .value = 1};
+    event.time.tv_sec = now.tv_sec - 1;
+    event.time.tv_usec = now.tv_nsec / 1000;
+    writer.push(event);
+    // without a timestamp, not counted
+    writer.push(input_event{.type = EV_SYN, .code = SYN_REPORT, .value = 0});
+    event.time.tv_sec = now.tv_sec + 100;
+    writer.push(event);
+    ASSERT_TRUE(writer.flush());
+
+    EXPECT_EQ(1, segment.histogram->count.load());
+    EXPECT_EQ(1, segment.histogram->skewed.load());
+    EXPECT_GE(segment.histogram->max.load(), 1000000000u);
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,113 @@
+#include "test_utils.h"
+#include "cache.h"
+
+using namespace schoenberg;
+
+namespace {
+
+    class TapHold : public EngineTest {
+    protected:
+        TapHold() : EngineTest(test_config()) {}
+
+        void SetUp() override {
+            config.tapping_term = 200;
+            rebuild();
+        }
+
+        void permissive() {
+            config.permissive_hold = true;
+            rebuild();
+        }
+    };
+
+}
+
+TEST_F(TapHold, tap_within_the_term) {
+    EXPECT_EQ(Events(), run(key_at(0, KEY_F, 1)));
+    EXPECT_EQ(time_at(200), next_deadline(state));
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}}), run(key_at(100, KEY_F, 0)));
+    // the press and the release are frames of their own
+    EXPECT_TRUE(out.frame_end(0));
+    EXPECT_EQ(nullptr, state.active());
+    EXPECT_EQ(0, next_deadline(state));
+}
+
+TEST_F(TapHold, held_past_the_term) {
+    run(key_at(0, KEY_F, 1));
+    EXPECT_EQ(Events(), expire_at(199));
+    EXPECT_EQ(time_at(200), next_deadline(state));
+    EXPECT_EQ(Events(), expire_at(200));
+    EXPECT_EQ(0, next_deadline(state));
+
+    EXPECT_EQ(Events({{KEY_DOWN, 1}}), run(key_at(300, KEY_J, 1)));
+    EXPECT_EQ(Events({{KEY_DOWN, 0}}), run(key_at(350, KEY_J, 0)));
+    // a hold is never a tap, however late it is released
+    EXPECT_EQ(Events(), run(key_at(400, KEY_F, 0)));
+    EXPECT_TRUE(state.key_state.count() == 0);
+}
+
+TEST_F(TapHold, rolling_over_the_prefix_is_a_tap) {
+    // typing "fj" fast: F is released before J
+    EXPECT_EQ(Events(), run(key_at(0, KEY_F, 1)));
+    EXPECT_EQ(Events(), run(key_at(50, KEY_J, 1)));
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}, {KEY_J, 1}}), run(key_at(80, KEY_F, 0)));
+    // the tap of the prefix and the replayed key are written as their own frames
+    EXPECT_TRUE(out.frame_end(0));
+    EXPECT_TRUE(out.frame_end(1));
+    EXPECT_EQ(Events({{KEY_J, 0}}), run(key_at(100, KEY_J, 0)));
+}
+
+TEST_F(TapHold, nested_tap_without_permissive_hold_is_a_tap) {
+    run(key_at(0, KEY_F, 1));
+    run(key_at(50, KEY_J, 1));
+    EXPECT_EQ(Events(), run(key_at(80, KEY_J, 0)));
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}, {KEY_J, 1}, {KEY_J, 0}}), run(key_at(100, KEY_F, 0)));
+}
+
+TEST_F(TapHold, nested_tap_with_permissive_hold_is_a_hold) {
+    permissive();
+    run(key_at(0, KEY_F, 1));
+    EXPECT_EQ(Events(), run(key_at(50, KEY_J, 1)));
+    EXPECT_EQ(Events({{KEY_DOWN, 1}, {KEY_DOWN, 0}}), run(key_at(80, KEY_J, 0)));
+    // the held back press and the release that decided are frames of their own
+    EXPECT_TRUE(out.frame_end(0));
+    EXPECT_EQ(Events(), run(key_at(100, KEY_F, 0)));
+}
+
+TEST_F(TapHold, held_back_keys_are_written_at_the_deadline) {
+    run(key_at(0, KEY_F, 1));
+    // U is mapped to LEFTSHIFT + LEFTBRACE in the layer
+    EXPECT_EQ(Events(), run(key_at(50, KEY_U, 1)));
+    EXPECT_EQ(Events({{KEY_LEFTSHIFT, 1}, {KEY_LEFTBRACE, 1}}), expire_at(200));
+    EXPECT_TRUE(out.frame_end(0));
+    EXPECT_EQ(Events({{KEY_LEFTBRACE, 0}, {KEY_LEFTSHIFT, 0}}), run(key_at(300, KEY_U, 0)));
+}
+
+TEST_F(TapHold, late_event_decides_without_expire) {
+    run(key_at(0, KEY_F, 1));
+    EXPECT_EQ(Events({{KEY_DOWN, 1}}), run(key_at(250, KEY_J, 1)));
+}
+
+TEST_F(TapHold, repeats_of_the_prefix_decide_nothing) {
+    run(key_at(0, KEY_F, 1));
+    EXPECT_EQ(Events(), run(key_at(30, KEY_F, 2)));
+    EXPECT_EQ(Events(), run(key_at(60, KEY_F, 2)));
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}}), run(key_at(100, KEY_F, 0)));
+}
+
+TEST_F(TapHold, mapping_applies_to_held_back_keys) {
+    run(key_at(0, KEY_F, 1));
+    // CAPSLOCK is mapped to ESC, ESC is not in the layer
+    run(key_at(50, KEY_CAPSLOCK, 1));
+    EXPECT_EQ(Events({{KEY_F, 1}, {KEY_F, 0}, {KEY_ESC, 1}}), run(key_at(80, KEY_F, 0)));
+}
+
+TEST(TapHoldConfig, parsed) {
+    auto config = read_config("tst/taphold.yaml");
+    EXPECT_EQ(180, config.tapping_term);
+    EXPECT_TRUE(config.permissive_hold);
+    auto state = build_state(config);
+    EXPECT_EQ(180 * MS, state.tapping_term);
+
+    EXPECT_EQ(0, read_config("tst/test.yaml").tapping_term);
+}
@@ -1,13 +1,19 @@
+#pragma once
+
 #include "gtest/gtest.h"
 #include "schoenberg.h"
 #include <unistd.h>
 #include <fstream>
 
+#ifdef SCHOENBERG_KEYMAP
+#include SCHOENBERG_KEYMAP
+#endif
+
 using namespace schoenberg;
 
 typedef vector<pair<__u16, string>> TYPE_EVENTS;
 
-vector<string> effective_keystrokes(TYPE_EVENTS event) {
+inline vector<string> effective_keystrokes(TYPE_EVENTS event) {
     auto res = vector<string>();
     for (auto e:event) {
         if (e.first == 1) {
@@ -17,49 +23,49 @@ vector<string> effective_keystrokes(TYPE_EVENTS event) {
     return res;
 }
 
-pair<Config, State> setup_test() {
-    auto config = schoenberg::read_config("tst/test.yaml");
+// tst/test.yaml. the keymap test build has it compiled in, process takes the compiled path for its engines
+inline Config test_config() {
+#ifdef SCHOENBERG_KEYMAP
+    return generated::config();
+#else
+    return read_config("tst/test.yaml");
+#endif
+}
+
+inline pair<Config, State> setup_test() {
+    auto config = test_config();
     return {config, schoenberg::build_state(config)};
 }
 
 
-TYPE_EVENTS process(Config &config, State &state, TYPE_EVENTS events) {
+// the events through the engine as the pipeline runs them, one process per event
+inline TYPE_EVENTS process(Config &config, State &state, TYPE_EVENTS events) {
     TYPE_EVENTS res;
-    for (auto eventInput :events) {
-
-        input_event i = {
-                .type = EV_KEY,
-                .code = (__u16) schoenberg::parse_key(
-                        eventInput.second),
-                eventInput.first
-        };
-
-        vector<input_event> imm = schoenberg::process_mapping(config, i, cout);
-
-        for (auto event: imm) {
-            auto item_res = schoenberg::process_for_layer(state, event, cout);
-            for (auto e:item_res) {
-                //auto entry = pair<__u16, string>{e.value,e.value};
-                res.push_back({(__u16) e.value, schoenberg::serialize_key(e.code)});
-            }
+    OutputBuffer<> out;
+    for (const auto &event: events) {
+        out.clear();
+        schoenberg::process(config, state, input_event{.type = EV_KEY, .code = (__u16) parse_key(event.second),
+                .value = event.first}, out);
+        for (const auto &e: out) {
+            res.push_back({(__u16) e.value, serialize_key(e.code)});
         }
     }
     return res;
 }
 
-void print_strokes(vector<string> strokes) {
+inline void print_strokes(vector<string> strokes) {
     for (const auto s:strokes) {
         cout << "=> " << s << endl;
     }
 }
 
-void print_events(TYPE_EVENTS events) {
+inline void print_events(TYPE_EVENTS events) {
     for (const auto s:events) {
         cout << "key: " << s.second << " value: " << s.first << endl;
     }
 }
 
-void events_equals(TYPE_EVENTS expected, TYPE_EVENTS actual) {
+inline void events_equals(TYPE_EVENTS expected, TYPE_EVENTS actual) {
     EXPECT_EQ(expected.size(), actual.size());
     if (expected.size() == actual.size()) {
         for (int i = 0; i < expected.size(); i++) {
@@ -78,7 +84,7 @@ void events_equals(TYPE_EVENTS expected, TYPE_EVENTS actual) {
     }
 }
 
-pair<State, TYPE_EVENTS> test_run(TYPE_EVENTS input, TYPE_EVENTS output, bool assert = true) {
+inline pair<State, TYPE_EVENTS> test_run(TYPE_EVENTS input, TYPE_EVENTS output, bool assert = true) {
     auto setup = setup_test();
     auto res = process(setup.first, setup.second, input);
     if (assert) {
@@ -87,7 +93,7 @@ pair<State, TYPE_EVENTS> test_run(TYPE_EVENTS input, TYPE_EVENTS output, bool as
     return {setup.second, res};
 }
 
-void assert_strokes(vector<string> expected, vector<string> actual) {
+inline void assert_strokes(vector<string> expected, vector<string> actual) {
     EXPECT_EQ(expected.size(), actual.size());
     if (expected.size() == actual.size()) {
         for (auto i = 0; i < expected.size(); i++) {
@@ -104,7 +110,7 @@ void assert_strokes(vector<string> expected, vector<string> actual) {
     }
 }
 
-void no_stroke_left_behind(TYPE_EVENTS events) {
+inline void no_stroke_left_behind(TYPE_EVENTS events) {
     auto key_state = std::map<string, int>();
     for (auto e: events) {
         key_state[e.second] = e.first;
@@ -118,3 +124,68 @@ void no_stroke_left_behind(TYPE_EVENTS events) {
     }
 }
 
+typedef vector<pair<int, int>> Events;
+
+const uint64_t MS = 1000000;
+
+// a key event at a time in ms on the virtual clock, the engine only knows the time from the events and expire
+inline input_event key_at(uint64_t ms, int code, int value) {
+    input_event event{.type = EV_KEY, .code = (__u16) code, .value = value};
+    event.time.tv_sec = 1000 + ms / 1000;
+    event.time.tv_usec = ms % 1000 * 1000;
+    return event;
+}
+
+// the time of key_at(ms, ...) in ns
+inline uint64_t time_at(uint64_t ms) {
+    return (1000 * 1000 + ms) * MS;
+}
+
+// the output as (code, value)
+inline Events pairs(const OutputSpan &out) {
+    Events res;
+    for (const auto &e: out) {
+        res.emplace_back(e.code, e.value);
+    }
+    return res;
+}
+
+// a key event through an engine of its own, like one a reload, a profile or a restart gave
+inline Events run(Engine &engine, int code, int value, uint64_t ms = 0) {
+    OutputBuffer<> out;
+    process(engine.config, engine.state, key_at(ms, code, value), out);
+    return pairs(out);
+}
+
+/**
+ * an engine that gets one event at a time, out holds the output of the last one
+ */
+class EngineTest : public ::testing::Test {
+protected:
+    Config config;
+    State state;
+    OutputBuffer<> out;
+
+    explicit EngineTest(Config config) : config(std::move(config)), state(build_state(this->config)) {}
+
+    // after the config was changed
+    void rebuild() {
+        state = build_state(config);
+    }
+
+    Events run(const input_event &event) {
+        out.clear();
+        process(config, state, event, out);
+        return pairs(out);
+    }
+
+    Events run(int code, int value, uint64_t ms = 0) {
+        return run(key_at(ms, code, value));
+    }
+
+    Events expire_at(uint64_t ms) {
+        out.clear();
+        expire(config, state, time_at(ms), out);
+        return pairs(out);
+    }
+};